@@ -0,0 +1,403 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * bench.c - host-side microbenchmarks for m65dbg's hot paths.
+ *
+ * Build with 'make m65bench', then run:
+ *
+ *   ./m65bench [<capture>]
+ *
+ * <capture> is raw monitor output as received over the serial link (eg, the
+ * response to a run of 'M' commands). Without one, a transcript of 'M'
+ * responses covering 1MB of memory is synthesised in the monitor's format.
+ *
+ * The symbol table benchmark loads a synthesised 100k-symbol map.
+ *
+ * Each benchmark checks that the new code decodes the same values as the code
+ * it replaced.
+ */
+
+#define _BSD_SOURCE _BSD_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include "monparse.h"
+#include "symtab.h"
+
+static long long now_us(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void report(const char* name, long long bytes, int reps, long long us)
+{
+  if (us <= 0)
+    us = 1;
+  printf("  %-28s %8.1f MB/s\n", name, (double)bytes * reps / us);
+}
+
+// ---------------------------------------------------------------------------
+// memory dump lines (fetch_ram's 'M' responses)
+
+static char* synth_mem_transcript(int* len)
+{
+  int blocks = 4096;  // 1MB
+  int size = blocks * (16 * 44 + 16);
+  char* buf = malloc(size + 1);
+  int ofs = 0;
+
+  for (int blk = 0; blk < blocks; blk++)
+  {
+    ofs += sprintf(&buf[ofs], "M%X\r\n", blk * 256);
+    for (int l = 0; l < 16; l++)
+    {
+      int addr = blk * 256 + l * 16;
+      ofs += sprintf(&buf[ofs], ":%08X:", addr);
+      for (int k = 0; k < 16; k++)
+        ofs += sprintf(&buf[ofs], "%02X", (addr + k) * 7 & 0xff);
+      ofs += sprintf(&buf[ofs], "\r\n");
+    }
+    ofs += sprintf(&buf[ofs], ".");
+  }
+
+  *len = ofs;
+  return buf;
+}
+
+// the way fetch_ram() used to do it: accumulate into an 8KB buffer, strstr()
+// for the next line's header, strtol() each hex pair, then bcopy() the rest
+// of the buffer down
+static int legacy_mem_parse(const char* in, int inlen, uint8_t* out)
+{
+  char read_buff[8192];
+  char next_addr_str[32];
+  int ofs = 0, pos = 0, got = 0;
+  unsigned int addr = 0;
+
+  // the address of the first line is where the read started
+  const char* first = strstr(in, "\n:");
+  if (first)
+    sscanf(&first[2], "%08X", &addr);
+
+  while (1)
+  {
+    int b = inlen - pos;
+    if (b > 1024)
+      b = 1024;   // roughly what a serial read hands back at a time
+    if ((ofs + b) > 8191)
+      b = 8191 - ofs;
+    memcpy(&read_buff[ofs], &in[pos], b);
+    pos += b;
+    ofs += b;
+    read_buff[ofs] = 0;
+
+    while (1)
+    {
+      snprintf(next_addr_str, sizeof(next_addr_str), "\n:%08X:", addr);
+      char* s = strstr(read_buff, next_addr_str);
+      if (!s || strlen(s) < 43)
+        break;
+      for (int i = 0; i < 16; i++)
+      {
+        char hex[3];
+        hex[0] = s[1+10+i*2+0];
+        hex[1] = s[1+10+i*2+1];
+        hex[2] = 0;
+        out[got++] = strtol(hex, NULL, 16);
+      }
+      addr += 16;
+      int s_offset = (long)s - (long)read_buff + 42;
+      bcopy(&read_buff[s_offset], &read_buff[0], 8192 - s_offset);
+      ofs -= s_offset;
+    }
+
+    if (b == 0)
+      break;
+  }
+  return got;
+}
+
+// the way fetch_ram() does it now: walk the buffer once, decoding lines in place
+static int stream_mem_parse(const char* in, int inlen, uint8_t* out)
+{
+  int got = 0;
+
+  for (int i = 0; i + 1 + MEM_LINE_LEN <= inlen; i++)
+  {
+    uint32_t addr;
+    if (in[i] != '\n' || in[i+1] != ':')
+      continue;
+    if (monparse_mem_line(&in[i+1], inlen - i - 1, &addr, &out[got]) < 0)
+      continue;
+    got += 16;
+    i += MEM_LINE_LEN;
+  }
+  return got;
+}
+
+static void bench_mem_lines(const char* in, int inlen)
+{
+  uint8_t* a = malloc(inlen);
+  uint8_t* b = malloc(inlen);
+  int reps = 5;
+  long long t;
+  int na = 0, nb = 0;
+
+  printf("memory lines (%d bytes of monitor output):\n", inlen);
+
+  t = now_us();
+  for (int r = 0; r < reps; r++)
+    na = legacy_mem_parse(in, inlen, a);
+  report("strstr/strtol/bcopy", inlen, reps, now_us() - t);
+
+  t = now_us();
+  for (int r = 0; r < reps; r++)
+    nb = stream_mem_parse(in, inlen, b);
+  report("streaming monparse", inlen, reps, now_us() - t);
+
+  if (na != nb || memcmp(a, b, na) != 0)
+    printf("  MISMATCH: legacy decoded %d bytes, streaming %d\n", na, nb);
+  else
+    printf("  (both decoded %d bytes identically)\n", nb);
+
+  free(a);
+  free(b);
+}
+
+// ---------------------------------------------------------------------------
+// single memory and register lines (get_mem()/get_regs())
+
+static void bench_fixed_lines(void)
+{
+  const char* mem_line = ":07772000:030A11181F262D343B424950575E656C";
+  const char* reg_line = "E0A8 00 00 00 00 00 01F9 0000 0000 A8 00 00 ..E...Z.";
+  int reps = 1000000;
+  long long t;
+  volatile unsigned int sink = 0;
+
+  printf("single lines (%d of each):\n", reps);
+
+  unsigned int addr, b[16];
+  t = now_us();
+  for (int r = 0; r < reps; r++)
+  {
+    sscanf(mem_line, ":%X:%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
+      &addr, &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7], &b[8], &b[9], &b[10], &b[11], &b[12], &b[13], &b[14], &b[15]);
+    sink += b[15];
+  }
+  report("mem line, sscanf", strlen(mem_line), reps, now_us() - t);
+
+  uint32_t addr32;
+  uint8_t bytes[16];
+  t = now_us();
+  for (int r = 0; r < reps; r++)
+  {
+    monparse_mem_line(mem_line, MEM_LINE_LEN, &addr32, bytes);
+    sink += bytes[15];
+  }
+  report("mem line, monparse", strlen(mem_line), reps, now_us() - t);
+
+  if (addr32 != addr)
+    printf("  MISMATCH in mem line address\n");
+  for (int k = 0; k < 16; k++)
+    if (bytes[k] != b[k])
+      printf("  MISMATCH in mem line byte %d\n", k);
+
+  int v[12];
+  char flags[16];
+  t = now_us();
+  for (int r = 0; r < reps; r++)
+  {
+    sscanf(reg_line, "%04X %02X %02X %02X %02X %02X %04X %04X %04X %02X %02X %02X %s",
+      &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8], &v[9], &v[10], &v[11], flags);
+    sink += v[0];
+  }
+  report("reg line, sscanf", strlen(reg_line), reps, now_us() - t);
+
+  static const int widths[12] = { 4, 2, 2, 2, 2, 2, 4, 4, 4, 2, 2, 2 };
+  int w[12];
+  char wflags[16];
+  t = now_us();
+  for (int r = 0; r < reps; r++)
+  {
+    const char* p = reg_line;
+    monparse_hex_fields(&p, widths, 12, w);
+    monparse_word(&p, wflags, sizeof(wflags));
+    sink += w[0];
+  }
+  report("reg line, monparse", strlen(reg_line), reps, now_us() - t);
+
+  if (memcmp(v, w, sizeof(v)) != 0 || strcmp(flags, wflags) != 0)
+    printf("  MISMATCH in reg line\n");
+}
+
+// ---------------------------------------------------------------------------
+// the symbol table (add_to_symmap()/find_in_symmap()/find_addr_in_symmap())
+
+#define SYMS 100000
+#define LEGACY_SYMS (SYMS / 10)   // the sorted list is quadratic, so it gets fewer
+
+typedef struct legacy_sym
+{
+  char* symbol;
+  int addr;
+  char* sval;
+  struct legacy_sym* next;
+} legacy_sym;
+
+// the way add_to_symmap() used to do it: walk the list to where it goes
+static void legacy_add(legacy_sym** lst, const char* symbol, int addr, const char* sval)
+{
+  legacy_sym** p = lst;
+  while (*p != NULL && (*p)->addr < addr)
+    p = &(*p)->next;
+
+  legacy_sym* e = malloc(sizeof(legacy_sym));
+  e->symbol = strdup(symbol);
+  e->addr = addr;
+  e->sval = strdup(sval);
+  e->next = *p;
+  *p = e;
+}
+
+static legacy_sym* legacy_find(legacy_sym* lst, const char* symbol)
+{
+  for (; lst != NULL; lst = lst->next)
+    if (strcmp(lst->symbol, symbol) == 0)
+      return lst;
+  return NULL;
+}
+
+// symbols as a cc65 .map or VICE .lbl would have them, in name order (so not
+// address order), with a few names and addresses repeated
+static void synth_symbol(int k, char* symbol, int* addr, char* sval)
+{
+  sprintf(symbol, "_module%03d_label%05d", k % 997, (k % 5 == 4) ? k - 1 : k);
+  *addr = (k * 7919) % 0x1000 + (k & 3) * 0x10000;
+  sprintf(sval, "%06X", *addr);
+}
+
+static void bench_symbols(void)
+{
+  char symbol[64], sval[16];
+  int addr;
+  long long t;
+  volatile int sink = 0;
+
+  printf("symbol table (%d symbols, the list with %d):\n", SYMS, LEGACY_SYMS);
+
+  legacy_sym* lst = NULL;
+  t = now_us();
+  for (int k = 0; k < LEGACY_SYMS; k++)
+  {
+    synth_symbol(k, symbol, &addr, sval);
+    legacy_add(&lst, symbol, addr, sval);
+  }
+  long long legacy_load = now_us() - t;
+
+  t = now_us();
+  for (int k = 0; k < LEGACY_SYMS; k++)
+  {
+    synth_symbol(k, symbol, &addr, sval);
+    sink += legacy_find(lst, symbol)->addr;
+  }
+  long long legacy_find_us = now_us() - t;
+
+  type_symtab st = { 0 };
+  t = now_us();
+  for (int k = 0; k < SYMS; k++)
+  {
+    synth_symbol(k, symbol, &addr, sval);
+    symtab_add(&st, symbol, addr, sval, NULL);
+  }
+  symtab_lower_bound(&st, 0);   // it sorts on the first lookup by address
+  long long load = now_us() - t;
+
+  t = now_us();
+  for (int k = 0; k < SYMS; k++)
+  {
+    synth_symbol(k, symbol, &addr, sval);
+    sink += symtab_find(&st, symbol)->addr;
+  }
+  long long find = now_us() - t;
+
+  printf("  %-28s %8.1f ms (%.2f us/symbol)\n", "load, sorted list", legacy_load / 1000.0, (double)legacy_load / LEGACY_SYMS);
+  printf("  %-28s %8.1f ms (%.2f us/symbol)\n", "load, hashed table", load / 1000.0, (double)load / SYMS);
+  printf("  %-28s %8.1f ms (%.2f us/lookup)\n", "find by name, sorted list", legacy_find_us / 1000.0, (double)legacy_find_us / LEGACY_SYMS);
+  printf("  %-28s %8.1f ms (%.2f us/lookup)\n", "find by name, hashed table", find / 1000.0, (double)find / SYMS);
+
+  // the same symbols in the same order, and the same ones found by name
+  type_symtab small = { 0 };
+  for (int k = 0; k < LEGACY_SYMS; k++)
+  {
+    synth_symbol(k, symbol, &addr, sval);
+    symtab_add(&small, symbol, addr, sval, NULL);
+  }
+  int k = 0;
+  bool same = true;
+  for (legacy_sym* e = lst; e != NULL; e = e->next, k++)
+  {
+    type_symmap_entry* sme = symtab_at(&small, k);
+    if (sme == NULL || sme->addr != e->addr || strcmp(sme->symbol, e->symbol) != 0 ||
+        symtab_find(&small, e->symbol)->addr != legacy_find(lst, e->symbol)->addr)
+      same = false;
+  }
+  if (!same || symtab_at(&small, k) != NULL)
+    printf("  MISMATCH between the list and the table\n");
+  else
+    printf("  (both hold the same %d symbols, in the same order)\n", k);
+
+  while (lst != NULL)
+  {
+    legacy_sym* e = lst;
+    lst = e->next;
+    free(e->symbol);
+    free(e->sval);
+    free(e);
+  }
+  symtab_clear(&st);
+  symtab_clear(&small);
+}
+
+// ---------------------------------------------------------------------------
+
+static char* load_file(const char* path, int* len)
+{
+  FILE* f = fopen(path, "rb");
+  if (!f)
+  {
+    printf("Could not open '%s'\n", path);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  *len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char* buf = malloc(*len + 1);
+  *len = fread(buf, 1, *len, f);
+  buf[*len] = 0;
+  fclose(f);
+  return buf;
+}
+
+int main(int argc, char** argv)
+{
+  int len;
+  char* transcript;
+
+  if (argc > 1)
+    transcript = load_file(argv[1], &len);
+  else
+    transcript = synth_mem_transcript(&len);
+
+  bench_mem_lines(transcript, len);
+  bench_fixed_lines();
+  bench_symbols();
+
+  free(transcript);
+  return 0;
+}
@@ -10,11 +10,22 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <math.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 #include "commands.h"
 #include "serial.h"
 #include "gs4510.h"
 #include "screen_shot.h"
 #include "m65.h"
+#include "monparse.h"
+#include "transport.h"
+#include "srcfile.h"
 
 #define KNRM  "\x1B[0m"
 #define KRED  "\x1B[31m"
@@ -120,11 +131,20 @@ void print_dword_at_address(char* token, int addr, bool useAddr28, bool show_dec
 void print_qword_at_address(char* token, int addr, bool useAddr28, bool show_decimal);
 char* toBinaryString(int val, poke_bitfield_info* bfi);
 mem_data* get_mem28array(int addr);
+void get_mem_lines(int addr, int count, bool useAddr28, mem_data* lines);
+void get_mem28blocks(int addr, int blocks, mem_data* lines);
+void bulk_read(int addr, unsigned char* buf, int count);
+void prefetch_add(int addr, bool useAddr28);
+void prefetch_run(void);
 int peek(unsigned int address);
+void poke_buffer_add(int key, unsigned char* buf, int count);
 void pokew(unsigned int address, int val);
 void poke(unsigned int address, int val);
 void set_mem(int addr, mem_data mem);
 void set_mem28array(int addr, mem_data* multimem);
+void stop_cpu_if_running(void);
+void call_temp_routine(char** routine);
+int disassemble_mem_into_string(char* str, int addr, bool useAddr28, mem_data* pmem);
 
 
 void out_errorcode(reg_data* reg)
@@ -348,7 +368,7 @@ type_command_details command_details[] =
   { "autowatch", cmdAutoWatch, "0/1", "If set to 1, shows all watches prior to every step/next/dis command" },
   { "symbol", cmdSymbolValue, "<symbol|$hex>", "retrieves the value of the symbol from the .map file. Alternatively, can find symbol name/s matching given $hex address. If two $hex values are given, it finds all symbols within this range" },
   { "save", cmdSave, "<binfile> <addr28> <count>", "saves out a memory dump to <binfile> starting from <addr28> and for <count> bytes" },
-  { "load", cmdLoad, "<binfile> <addr28> (<offset> <count>)", "loads in <binfile> to <addr28> (with an optional offset and count of bytes to load)" },
+  { "load", cmdLoad, "[--delta] [-z] <binfile> <addr28> (<offset> <count>)", "loads in <binfile> to <addr28> (with an optional offset and count of bytes to load). With --delta, only the pages that differ from the target's memory are sent. With -z, it's sent compressed and expanded by a routine on the target" },
   { "poke", cmdPoke, "<addr16> <byte/s>", "pokes byte value/s into <addr16> (and beyond, if multiple values)" },
   { "pokew", cmdPokeW, "<addr16> <word/s>", "pokes word value/s into <addr16> (and beyond, if multiple values)" },
   { "poked", cmdPokeD, "<addr16> <dword/s>", "pokes dword value/s into <addr16> (and beyond, if multiple values)" },
@@ -366,12 +386,16 @@ type_command_details command_details[] =
   { "ftp", cmdFtp, NULL, "FTP access to SD-card" },
   { "petscii", cmdPetscii, "0/1", "In dump commands, respect petscii screen codes" },
   { "fastmode", cmdFastMode, "0/1", "Used to quickly switch between 2,000,000bps (slow-mode: default) or 4,000,000bps (fast-mode: used in ftp-mode)" },
+  { "fastread", cmdFastRead, "0/1", "If set to 1, installs the ftp helper routine (switching to C64 mode and overwriting memory from $0801) and uses it for the bulk memory reads of save/mdump/se/ss" },
+  { "pagesums", cmdPageSums, "0/1 [<addr16>]", "If set to 1, after a step, stale cached memory is checked by a checksum routine run on the target, which borrows up to 1KB at <addr16> (default $C000) while it runs, so that only changed pages get fetched again" },
+  { "memcache", cmdMemCache, "[<kb>]", "Shows the state of the memory cache. If <kb> is given, sets its size limit (default 1024)" },
   { "scope", cmdScope, "<int>", "the scope-size of the listing to show alongside the disassembly" },
   { "offs", cmdOffs, "<int>", "the offset of the listing to show alongside the disassembly" },
   { "val", cmdPrintValue, "<hex/#dec/\%bin/>", "print the given value in hex, decimal and binary" },
   { "=", cmdForwardDis, "[<count>]", "move forward in disassembly of pc history from 'z' command" },
   { "-", cmdBackwardDis, "[<count>]", "move backward in disassembly of pc history from 'z' command" },
   { "mcopy", cmdMCopy, "<src_addr> <dest_addr> <count>", "copy data from source location to destination (28-bit addresses)" },
+  { "mfill", cmdMFill, "<addr28> <count> <byte>", "fill <count> bytes from <addr28> with <byte>" },
   { "locals", cmdLocals, NULL, "Print out the values of any local variables within the current c-function (needs gurce's cc65 .list file)" },
   { "autolocals", cmdAutoLocals, "0/1", "If set to 1, shows all locals prior to every step/next/dis command" },
   { "mapping", cmdMapping, NULL, "Summarise the current $D030/MAP/$01 mapping of the system" },
@@ -385,6 +409,7 @@ type_command_details command_details[] =
 "                 If the index is in the form $xxxx, it is treated as an absolute memory address." },
   { "set", cmdSet, "<addr> <string|bytes>", "set bytes at the given address to the desired string or bytes" },
   { "reload", cmdReload, NULL, "reloads any list and map files (in-case you've rebuilt them recently)" },
+  { "watchbuild", cmdWatchBuild, "<binfile> <addr28> [<restart_addr>]", "loads <binfile> to <addr28>, then watches for it (and the list and map files) being rebuilt, pushing only the bytes that changed and re-indexing only the files that changed, until ctrl-c. With <restart_addr>, the PC is set to it after each push (linux only)" },
   { "go", cmdGo, "<addr>", "sets the PC to the desired address." },
   { "palette", cmdPalette, "<startidx> <endidx>", "Shows details of the palette for the given range. If no range given, the first 32 colour indices are selected." },
   { "hyppo", cmdHyppo, "<servicename>", "Performs the desired hyppo call. Note that in many cases, you will have to prepare inputs prior to this call, and assess outputs after the call." },
@@ -396,7 +421,7 @@ char* get_extension(char* fname)
   return strrchr(fname, '.');
 }
 
-int prior_offset = 0; // to help keep track of stack offsets of local variables within functions
+__thread int prior_offset = 0; // to help keep track of stack offsets of local variables within functions
 
 typedef struct tli
 {
@@ -415,8 +440,8 @@ typedef struct tfi
   struct tfi *next;
 } type_funcinfo;
 
-type_funcinfo* lstFuncInfo = NULL;
-type_funcinfo* cur_func_info = NULL;
+__thread type_funcinfo* lstFuncInfo = NULL;
+__thread type_funcinfo* cur_func_info = NULL;
 
 typedef struct tcili
 {
@@ -430,28 +455,101 @@ typedef struct tcili
 
 type_ci_chunk_info* lstCalypsiChunkInfo = NULL;
 
-typedef struct tfl
-{
-  int addr;
-  int lastaddr;
-  char* file;
-  char* module;
-  int lineno;
-  struct tfl *next;
-} type_fileloc;
-
-type_fileloc* lstFileLoc = NULL;
+type_filelocs fileLocs = { 0 };
 
 type_fileloc* cur_file_loc = NULL;
 
-type_symmap_entry* lstSymMap = NULL;
+type_srcfiles srcFiles = { 0 };
+
+type_symtab symMap = { 0 };
 
-type_offsets segmentOffsets = {{ 0 }};
+__thread type_offsets segmentOffsets = {{ 0 }};
 
-type_offsets* lstModuleOffsets = NULL;
+__thread type_offsets* lstModuleOffsets = NULL;
 
 type_watch_entry* lstWatches = NULL;
 
+// the debug file being loaded, which the entries added to the lists are
+// tagged with, so they can be dropped again when just that file is reloaded
+// (see load_debug_file())
+__thread const char* loading_origin = NULL;
+
+// a debug file loaded by listSearch() on a worker thread, into tables of its
+// own that are merged into the global ones afterwards, in the order the files
+// were found. Whatever its parse looked up that a file before it could have
+// loaded too is noted, so that it can be loaded again in order if need be.
+typedef struct
+{
+  char* fname;
+  const char* origin;
+  bool done;              // loaded on a worker (or from the cache)
+  bool serial;            // its parse needs what the files before it loaded
+  bool used_prior_func;   // has locals for the last function of the file before
+  long long us;
+  char* log;              // what it would have printed
+  int log_len;
+  const char* cached;     // its record in the debug-info cache, if it came from there
+  int cached_len;
+  const char* cached_tables;  // and its symbols and lines there, left for the merge
+  int dep_cnt;            // the files its parse reads, and their versions
+  char deps[2][256];
+  long long dep_mtime[2];
+  long long dep_size[2];
+
+  type_symtab symbols;
+  type_filelocs filelocs;
+  type_offsets segments;
+  bool segments_loaded;
+  bool used_global_segments;
+  type_offsets* modules;
+  type_funcinfo* funcs;
+  type_funcinfo* cur_func;
+  int prior_offset;
+
+  char** sym_names;       // the symbols and modules it looked up
+  int sym_name_cnt;
+  char** module_names;
+  int module_name_cnt;
+} type_load_job;
+
+// the job the current thread is loading, if it's a worker
+__thread type_load_job* load_job = NULL;
+
+void note_name(char*** names, int* cnt, const char* name)
+{
+  if (*cnt > 0 && strcmp((*names)[*cnt - 1], name) == 0)
+    return;
+
+  // grows by doubling
+  if ((*cnt & (*cnt - 1)) == 0)
+    *names = realloc(*names, (*cnt ? *cnt * 2 : 1) * sizeof(char*));
+  (*names)[(*cnt)++] = strdup(name);
+}
+
+// prints a "Loading ..." note, or on a worker, keeps it for printing when the
+// file is merged
+void load_note(const char* fmt, ...)
+{
+  va_list valist;
+  va_start(valist, fmt);
+
+  if (load_job == NULL)
+    vprintf(fmt, valist);
+  else
+  {
+    char str[512];
+    int len = vsnprintf(str, sizeof(str), fmt, valist);
+    if (len >= (int)sizeof(str))
+      len = sizeof(str) - 1;
+
+    load_job->log = realloc(load_job->log, load_job->log_len + len + 1);
+    memcpy(load_job->log + load_job->log_len, str, len + 1);
+    load_job->log_len += len;
+  }
+
+  va_end(valist);
+}
+
 void clearSoftBreak(void);
 int isCpuStopped(void);
 void setSoftBreakpoint(int addr);
@@ -599,117 +697,13 @@ type_ci_chunk_info* add_calypsi_chunk_info(char* chunk_name, char* section, int
 
 type_fileloc* add_to_list(type_fileloc fl)
 {
-  type_fileloc* iter = lstFileLoc;
-
-  // first entry in list?
-  if (lstFileLoc == NULL)
-  {
-    lstFileLoc = malloc(sizeof(type_fileloc));
-    lstFileLoc->addr = fl.addr;
-    lstFileLoc->lastaddr = fl.lastaddr;
-    lstFileLoc->file = strdup(fl.file);
-    lstFileLoc->lineno = fl.lineno;
-    lstFileLoc->module = fl.module;
-    lstFileLoc->next = NULL;
-    return lstFileLoc;
-  }
-
-  while (iter != NULL)
-  {
-    // replace existing?
-    if (iter->addr == fl.addr)
-    {
-      iter->file = strdup(fl.file);
-      iter->lineno = fl.lineno;
-      return iter;
-    }
-    // insert entry?
-    if (iter->addr > fl.addr)
-    {
-      type_fileloc* flcpy = malloc(sizeof(type_fileloc));
-      flcpy->addr = iter->addr;
-      flcpy->lastaddr = iter->lastaddr;
-      flcpy->file = iter->file;
-      flcpy->lineno = iter->lineno;
-      flcpy->module = iter->module;
-      flcpy->next = iter->next;
-
-      iter->addr = fl.addr;
-      iter->lastaddr = fl.lastaddr;
-      iter->file = strdup(fl.file);
-      iter->lineno = fl.lineno;
-      iter->module = fl.module;
-      iter->next = flcpy;
-      return iter;
-    }
-    // add to end?
-    if (iter->next == NULL)
-    {
-      type_fileloc* flnew = malloc(sizeof(type_fileloc));
-      flnew->addr = fl.addr;
-      flnew->lastaddr = fl.lastaddr;
-      flnew->file = strdup(fl.file);
-      flnew->lineno = fl.lineno;
-      flnew->module = fl.module;
-      flnew->next = NULL;
-
-      iter->next = flnew;
-      return flnew;
-    }
-
-    iter = iter->next;
-  }
-
-  return NULL;
+  fl.origin = loading_origin;
+  return fileloc_add(load_job != NULL ? &load_job->filelocs : &fileLocs, &fl);
 }
 
 void add_to_symmap(type_symmap_entry sme)
 {
-  type_symmap_entry* iter = lstSymMap;
-
-  // first entry in list?
-  if (lstSymMap == NULL)
-  {
-    lstSymMap = malloc(sizeof(type_symmap_entry));
-    lstSymMap->addr = sme.addr;
-    lstSymMap->sval = strdup(sme.sval);
-    lstSymMap->symbol = strdup(sme.symbol);
-    lstSymMap->next = NULL;
-    return;
-  }
-
-  while (iter != NULL)
-  {
-    // insert entry?
-    if (iter->addr >= sme.addr)
-    {
-      type_symmap_entry* smecpy = malloc(sizeof(type_symmap_entry));
-      smecpy->addr = iter->addr;
-      smecpy->sval = iter->sval;
-      smecpy->symbol = iter->symbol;
-      smecpy->next = iter->next;
-
-      iter->addr = sme.addr;
-      iter->sval = strdup(sme.sval);
-      iter->symbol = strdup(sme.symbol);
-      iter->next = smecpy;
-      return;
-    }
-    // add to end?
-    if (iter->next == NULL)
-    {
-      type_symmap_entry* smenew = malloc(sizeof(type_symmap_entry));
-      smenew->addr = sme.addr;
-      smenew->sval = strdup(sme.sval);
-      smenew->symbol = strdup(sme.symbol);
-      smenew->next = NULL;
-
-      iter->next = smenew;
-      return;
-    }
-
-    iter = iter->next;
-  }
+  symtab_add(load_job != NULL ? &load_job->symbols : &symMap, sme.symbol, sme.addr, sme.sval, loading_origin);
 }
 
 void copy_watch(type_watch_entry* dest, type_watch_entry* src)
@@ -752,69 +746,33 @@ void add_to_watchlist(type_watch_entry we)
 
 type_fileloc* find_in_list(int addr)
 {
-  type_fileloc* iter = lstFileLoc;
-
-  while (iter != NULL)
-  {
-    //printf("%s : addr=$%04X : line=%d\n", iter->file, iter->addr, iter->lineno);
-    if (iter->addr == addr)
-      return iter;
-
-    if (iter->lastaddr != 0 && (iter->addr < addr && addr <= iter->lastaddr))
-      return iter;
-
-    iter = iter->next;
-  }
-
-  return NULL;
+  return fileloc_find(&fileLocs, addr);
 }
 
 int find_addr_in_list(char* file, int line)
 {
-  type_fileloc* iter = lstFileLoc;
-
-  while (iter != NULL)
-  {
-    if (!strcmp(file, iter->file) && iter->lineno == line)
-      return iter->addr;
-
-    iter = iter->next;
-  }
+  type_fileloc* fl = fileloc_find_line(&fileLocs, file, line);
 
-  return -1;
+  return fl != NULL ? fl->addr : -1;
 }
 
 type_fileloc* find_lineno_in_list(int lineno)
 {
-  type_fileloc* iter = lstFileLoc;
-
   if (!cur_file_loc)
     return NULL;
 
-  while (iter != NULL)
-  {
-    if (strcmp(cur_file_loc->file, iter->file) == 0 && iter->lineno == lineno)
-      return iter;
-
-    iter = iter->next;
-  }
-
-  return NULL;
+  return fileloc_find_line(&fileLocs, cur_file_loc->file, lineno);
 }
 
 type_symmap_entry* find_in_symmap(char* sym)
 {
-  type_symmap_entry* iter = lstSymMap;
-
-  while (iter != NULL)
+  if (load_job != NULL)
   {
-    if (strcmp(sym, iter->symbol) == 0)
-      return iter;
-
-    iter = iter->next;
+    note_name(&load_job->sym_names, &load_job->sym_name_cnt, sym);
+    return symtab_find(&load_job->symbols, sym);
   }
 
-  return NULL;
+  return symtab_find(&symMap, sym);
 }
 
 type_watch_entry* find_in_watchlist(type_watch type, char* name)
@@ -882,7 +840,7 @@ char* get_string_token(char* p, char* name);
 
 char* get_nth_token(char* p, int n)
 {
-  static char token[128];
+  static __thread char token[128];
 
   for (int k = 0; k <= n; k++)
   {
@@ -943,6 +901,8 @@ void parse_ca65_segments(FILE* f, char* line)
   char *p;
 
   memset(&segmentOffsets, 0, sizeof(segmentOffsets));
+  if (load_job != NULL)
+    load_job->segments_loaded = true;
 
   while (!feof(f))
   {
@@ -1126,7 +1086,7 @@ void load_map(const char* fname)
   // check if file exists
   if (access(strMapFile, F_OK) != -1)
   {
-    printf("Loading \"%s\"...\n", strMapFile);
+    load_note("Loading \"%s\"...\n", strMapFile);
 
     // load the map file
     FILE* f = fopen(strMapFile, "rt");
@@ -1166,6 +1126,9 @@ void load_map(const char* fname)
 
 int get_segment_offset(const char* current_segment)
 {
+  if (load_job != NULL && !load_job->segments_loaded)
+    load_job->used_global_segments = true;
+
   for (int k = 0; k < segmentOffsets.seg_cnt; k++)
   {
     if (strcmp(current_segment, segmentOffsets.segments[k].name) == 0)
@@ -1180,6 +1143,9 @@ int get_module_offset(const char* current_module, const char* current_segment)
 {
   type_offsets* iter = lstModuleOffsets;
 
+  if (load_job != NULL)
+    note_name(&load_job->module_names, &load_job->module_name_cnt, current_module);
+
   while (iter != NULL)
   {
     if (strcmp(current_module, iter->modulename) == 0)
@@ -1201,6 +1167,9 @@ char* get_module_string(const char* current_module)
 {
   type_offsets* iter = lstModuleOffsets;
 
+  if (load_job != NULL)
+    note_name(&load_job->module_names, &load_job->module_name_cnt, current_module);
+
   while (iter != NULL)
   {
     if (strcmp(current_module, iter->modulename) == 0)
@@ -1232,7 +1201,7 @@ void parse_function(char* line, int addr)
 
 void parse_debug(char* line)
 {
-  if (cur_func_info == NULL)
+  if (cur_func_info == NULL && load_job == NULL)
     return;
 
   char *p1 = get_nth_token(line, 2);
@@ -1250,6 +1219,13 @@ void parse_debug(char* line)
       char* type = get_nth_token(line, 6);
       if (strcasecmp(type, "auto,") == 0)
       {
+        // (on a worker) belongs to the function the file before ended in?
+        if (cur_func_info == NULL)
+        {
+          load_job->used_prior_func = true;
+          return;
+        }
+
         char* name = get_nth_token(line, 4);
         name[strlen(name)-2] = '\0';  // trim the end quote and comma
 
@@ -1277,7 +1253,7 @@ void parse_debug(char* line)
 
 void load_ca65_list(const char* fname, FILE* f)
 {
-  static char list_file_name[256];
+  static __thread char list_file_name[256];
   strcpy(list_file_name, fname); // preserve a copy of this eternally
 
   load_map(fname); // load the ca65 map file first, as it contains details that will help us parse the list file
@@ -1406,10 +1382,11 @@ void load_list(char* fname)
       int addr;
       char file[1024];
       int lineno;
-      strcpy(file, &strtok(s, ":")[1]);
+      char* save;
+      strcpy(file, &strtok_r(s, ":", &save)[1]);
       if (strrchr(line, '/'))
         strcpy(file, strrchr(file, '/') + 1);
-      sscanf(strtok(NULL, ":"), "%d", &lineno);
+      sscanf(strtok_r(NULL, ":", &save), "%d", &lineno);
       sscanf(line, " %X", &addr);
 
       //printf("%04X : %s:%d\n", addr, file, lineno);
@@ -1499,7 +1476,7 @@ void load_acme_map(const char* fname)
   // check if file exists
   if (access(strMapFile, F_OK) != -1)
   {
-    printf("Loading \"%s\"...\n", strMapFile);
+    load_note("Loading \"%s\"...\n", strMapFile);
 
     // load the map file
     FILE* f = fopen(strMapFile, "rt");
@@ -1688,7 +1665,7 @@ void load_kickass_map(char* fname)
   // check if file exists
   if (access(strMapFile, F_OK) != -1)
   {
-    printf("Loading \"%s\"...\n", strMapFile);
+    load_note("Loading \"%s\"...\n", strMapFile);
 
     // load the map file
     FILE* f = fopen(strMapFile, "rt");
@@ -1700,14 +1677,14 @@ void load_kickass_map(char* fname)
       //char sval[256];
       int addr;
       char sym[1024];
-      char *token;
+      char *token, *save;
       //if ((strlen(line)>7) && (strstr(line, ".label "))) {
       if((fgets(line, 1024, f) != NULL) && (starts_with(line, ".label "))) {
         strcpy(cpy_line,line);
 
         char* asmname = strstr(line, ".label ") + strlen(".label ");
 
-        token = strtok(asmname, "=");
+        token = strtok_r(asmname, "=", &save);
 
         strcpy(sym,token);
 
@@ -2106,7 +2083,7 @@ void load_calypsi_map(const char* fname)
   // check if file exists
   if (access(strMapFile, F_OK) != -1)
   {
-    printf("Loading \"%s\"...\n", strMapFile);
+    load_note("Loading \"%s\"...\n", strMapFile);
 
     // load the map file
     ci.f = fopen(strMapFile, "rt");
@@ -2160,7 +2137,7 @@ void load_KickAss_list(char* fname)
       // Controlla se la riga contiene un indirizzo (assumiamo che inizi con un indirizzo in esadecimale)
       //unsigned int address;
       int addr;
-      char *token;
+      char *token, *save;
 
       if (starts_with(line, "****") && strstr(line, "Segment:"))
       {
@@ -2178,7 +2155,7 @@ void load_KickAss_list(char* fname)
       }
       else if (strstr(line, "-") != NULL){
           // first :
-          token = strtok(line, ":");
+          token = strtok_r(line, ":", &save);
           //printf("find the address: %s\n", token);
           sscanf(token, "%04X", &addr);
 
@@ -2200,230 +2177,2202 @@ void load_KickAss_list(char* fname)
 
 void show_location(type_fileloc* fl)
 {
-  FILE* f = fopen(fl->file, "rt");
-  if (f == NULL)
+  type_srcfile* sf = srcfile_get(&srcFiles, fl->file, &fileLocs);
+  if (sf == NULL)
     return;
-  char line[1024];
-  int cnt = 1;
 
-  while (!feof(f))
+  int first = fl->lineno - dis_scope + dis_offs;
+  int last = fl->lineno + dis_scope + dis_offs;
+  if (first < 1)
+    first = 1;
+  if (last > sf->line_cnt)
+    last = sf->line_cnt;
+
+  for (int cnt = first; cnt <= last; cnt++)
   {
-    fgets(line, 1024, f);
-    if (cnt >= (fl->lineno - dis_scope + dis_offs) && cnt <= (fl->lineno + dis_scope + dis_offs) )
-    {
-      int addr = find_addr_in_list(fl->file, cnt);
-      char saddr[16] = "       ";
-      if (addr != -1)
-        sprintf(saddr, "[$%04X]", addr);
+    const char* line = sf->text + sf->line_offs[cnt - 1];
+    int len = sf->line_offs[cnt] - sf->line_offs[cnt - 1];
+    int addr = sf->line_addrs[cnt - 1];
+    char saddr[16] = "       ";
+    if (addr != -1)
+      sprintf(saddr, "[$%04X]", addr);
 
-      if (cnt == fl->lineno)
-      {
-        printf("%s> L%d: %s %s%s", KINV, cnt, saddr, line, KNRM);
-      }
-      else
-        printf("> L%d: %s %s", cnt, saddr, line);
-      //break;
+    if (cnt == fl->lineno)
+    {
+      printf("%s> L%d: %s %.*s%s", KINV, cnt, saddr, len, line, KNRM);
     }
-    cnt++;
+    else
+      printf("> L%d: %s %.*s", cnt, saddr, len, line);
   }
-  fclose(f);
 }
 
-// search the current directory for *.list files
-void listSearch(void)
-{
-  bool calypsi_map_loaded = false;
-  DIR           *d;
-  struct dirent *dir;
+// the names of the debug files loaded so far, which the list entries point to
+// as their origin
+char** debug_files = NULL;
+int debug_files_cnt = 0;
 
-  d = opendir(".");
-  if (d)
-  {
-    while ((dir = readdir(d)) != NULL)
-    {
-      char* ext = get_extension(dir->d_name);
-      // VICE label file?
-      if (ext != NULL && strcmp(ext, ".lbl") == 0)
-      {
-        printf("Loading \"%s\"...\n", dir->d_name);
-        load_lbl(dir->d_name);
-      }
-      // .klist = KickAss Compiler
-      if (ext != NULL && strcmp(ext, ".klist") == 0)
-      {
-        printf("Loading \"%s\"...\n", dir->d_name);
-        load_KickAss_list(dir->d_name);
-      }
-      if (ext != NULL && strcmp(ext, ".clst") == 0)
-      {
-        printf("Loading \"%s\"...\n", dir->d_name);
-        if (!calypsi_map_loaded) {
-          load_calypsi_map(dir->d_name);
-          calypsi_map_loaded = true;
-        }
-        load_calypsi_list(dir->d_name);
-      }
-      // .lst = BSA Compiler for MEGA65 ROM
-      if (ext != NULL && strcmp(ext, ".lst") == 0)
-      {
-        printf("Loading \"%s\"...\n", dir->d_name);
-        load_bsa_list(dir->d_name);
-      }
-      // .list = Ophis or CA65?
-      if (ext != NULL && strcmp(ext, ".list") == 0)
-      {
-        printf("Loading \"%s\"...\n", dir->d_name);
-        load_list(dir->d_name);
-      }
-      // .rep = ACME (report file, equivalent to .list)
-      else if (ext != NULL && strcmp(ext, ".rep") == 0)
-      {
-        printf("Loading \"%s\"...\n", dir->d_name);
-        load_acme_list(dir->d_name);
-      }
-    }
+const char* debug_file_origin(const char* fname)
+{
+  for (int k = 0; k < debug_files_cnt; k++)
+    if (strcmp(debug_files[k], fname) == 0)
+      return debug_files[k];
 
-    closedir(d);
-  }
+  debug_files = realloc(debug_files, (debug_files_cnt + 1) * sizeof(char*));
+  debug_files[debug_files_cnt] = strdup(fname);
+  return debug_files[debug_files_cnt++];
 }
 
-reg_data get_regs(void)
+// is 'fname' one of the list or label files we know?
+bool is_debug_file(char* fname)
 {
-  reg_data reg = { 0 };
-  char* line;
-  while (1) {
-    serialWrite("r\n");
-    serialRead(inbuf, BUFSIZE);
-    line = strstr(inbuf+2, "\n");
-    if (!line) // did we hit a null+1? try again
-      continue;
-    line++;
-    sscanf(line,"%04X %02X %02X %02X %02X %02X %04X %04X %04X %02X %02X %02X %s",
-      &reg.pc, &reg.a, &reg.x, &reg.y, &reg.z, &reg.b, &reg.sp, &reg.maph, &reg.mapl, &reg.lastop, &reg.odd1, &reg.odd2, reg.flags);
-    break;
-  }
+  char* ext = get_extension(fname);
+  if (ext == NULL)
+    return false;
 
-  return reg;
+  return strcmp(ext, ".lbl") == 0 || strcmp(ext, ".klist") == 0 || strcmp(ext, ".clst") == 0 ||
+      strcmp(ext, ".lst") == 0 || strcmp(ext, ".list") == 0 || strcmp(ext, ".rep") == 0;
 }
 
-void show_regs(reg_data* reg)
+// loads the debug file 'fname', tagging what's loaded with 'origin'
+void load_debug_file_as(char* fname, const char* origin, bool* calypsi_map_loaded)
 {
-  printf("PC   A  X  Y  Z  B  SP   MAPH MAPL LAST-OP     P  P-FLAGS   RGP uS IO\n");
-  printf("%04X %02X %02X %02X %02X %02X %04X %04X %04X %02X       %02X %02X %s\n", reg->pc, reg->a, reg->x, reg->y, reg->z, reg->b, reg->sp, reg->maph, reg->mapl, reg->lastop, reg->odd1, reg->odd2, reg->flags);
-  printf("     ");
-  print_char(reg->a);
-  printf("  ");
-  print_char(reg->x);
-  printf("  ");
-  print_char(reg->y);
-  printf("  ");
-  print_char(reg->z);
-  printf("\n");
-}
+  char* ext = get_extension(fname);
 
-mem_data get_mem(int addr, bool useAddr28)
-{
-  mem_data mem = { 0 };
-  char str[100];
-  if (useAddr28)
-    sprintf(str, "m%07X\n", addr); // use 'm' (for 28-bit memory addresses)
-  else
-    sprintf(str, "m777%04X\n", addr); // set upper 12-bis to $777xxxx (for memory in cpu context)
+  load_note("Loading \"%s\"...\n", fname);
+  loading_origin = origin;
 
-  serialWrite(str);
-  serialRead(inbuf, BUFSIZE);
-  sscanf(inbuf, ":%X:%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
-  &mem.addr, &mem.b[0], &mem.b[1], &mem.b[2], &mem.b[3], &mem.b[4], &mem.b[5], &mem.b[6], &mem.b[7], &mem.b[8], &mem.b[9], &mem.b[10], &mem.b[11], &mem.b[12], &mem.b[13], &mem.b[14], &mem.b[15]);
+  // VICE label file?
+  if (strcmp(ext, ".lbl") == 0)
+    load_lbl(fname);
+  // .klist = KickAss Compiler
+  else if (strcmp(ext, ".klist") == 0)
+    load_KickAss_list(fname);
+  else if (strcmp(ext, ".clst") == 0)
+  {
+    if (!*calypsi_map_loaded) {
+      load_calypsi_map(fname);
+      *calypsi_map_loaded = true;
+    }
+    load_calypsi_list(fname);
+  }
+  // .lst = BSA Compiler for MEGA65 ROM
+  else if (strcmp(ext, ".lst") == 0)
+    load_bsa_list(fname);
+  // .list = Ophis or CA65?
+  else if (strcmp(ext, ".list") == 0)
+    load_list(fname);
+  // .rep = ACME (report file, equivalent to .list)
+  else
+    load_acme_list(fname);
 
-  return mem;
+  loading_origin = NULL;
 }
 
-int peek(unsigned int address)
+// loads 'fname' if it's one of the list or label files we know.
+// Returns false if it isn't.
+bool load_debug_file(char* fname, bool* calypsi_map_loaded)
 {
-  mem_data mem = get_mem(address, false);
-  return mem.b[0];
+  if (!is_debug_file(fname))
+    return false;
+
+  load_debug_file_as(fname, debug_file_origin(fname), calypsi_map_loaded);
+  return true;
 }
 
-int mpeek(unsigned int address)
+// drops everything that was loaded from the debug file 'origin' (as given by
+// debug_file_origin())
+void unload_debug_file(const char* origin)
 {
-  mem_data mem = get_mem(address, true);
-  return mem.b[0];
+  fileloc_remove_origin(&fileLocs, origin);
+  symtab_remove_origin(&symMap, origin);
 }
 
-int mpeekw(unsigned int address)
+#define LOAD_THREADS_MAX 8
+
+bool load_verbose = false;
+
+type_load_job* load_jobs = NULL;
+int load_job_cnt = 0;
+int load_job_next = 0;
+pthread_mutex_t load_job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void free_func_list(type_funcinfo* fi)
 {
-  mem_data mem = get_mem(address, true);
-  return mem.b[0] + (mem.b[1] << 8);
+  while (fi != NULL)
+  {
+    type_funcinfo* next = fi->next;
+    type_localinfo* li = fi->locals;
+    while (li != NULL)
+    {
+      type_localinfo* linext = li->next;
+      free(li->name);
+      free(li);
+      li = linext;
+    }
+    free(fi->name);
+    free(fi);
+    fi = next;
+  }
 }
 
-void poke(unsigned int address, int val)
+// drops everything a worker (or the cache) loaded for 'job', the log too
+void discard_load_job(type_load_job* job)
 {
-  char command_str[1024] = { 0 };
-  char nval[10];
-
-  sprintf(command_str, "s %04X ", address);
+  symtab_clear(&job->symbols);
+  fileloc_clear(&job->filelocs);
 
-  sprintf(nval, "%02X", val);
-  strcat(command_str, nval);
-  strcat(command_str, " ");
+  while (job->modules != NULL)
+  {
+    type_offsets* next = job->modules->next;
+    free(job->modules);
+    job->modules = next;
+  }
+  free_func_list(job->funcs);
+  job->funcs = NULL;
 
-  strcat(command_str, "\n");
+  for (int k = 0; k < job->sym_name_cnt; k++)
+    free(job->sym_names[k]);
+  free(job->sym_names);
+  for (int k = 0; k < job->module_name_cnt; k++)
+    free(job->module_names[k]);
+  free(job->module_names);
+  free(job->log);
 
-  serialWrite(command_str);
-  serialRead(inbuf, BUFSIZE);
+  job->sym_names = job->module_names = NULL;
+  job->sym_name_cnt = job->module_name_cnt = 0;
+  job->log = NULL;
+  job->log_len = 0;
+  job->used_prior_func = job->used_global_segments = job->segments_loaded = false;
+  memset(&job->segments, 0, sizeof(job->segments));
+  job->cur_func = NULL;
+  job->prior_offset = 0;
+  job->cached_tables = NULL;
 }
 
-void pokew(unsigned int address, int val)
+void* load_worker(void* arg)
 {
-  char command_str[1024] = { 0 };
-  char nval[10];
+  bool calypsi_map_loaded = true; // (they're never given a .clst)
+
+  while (1)
+  {
+    pthread_mutex_lock(&load_job_lock);
+    while (load_job_next < load_job_cnt && (load_jobs[load_job_next].serial || load_jobs[load_job_next].done))
+      load_job_next++;
+    type_load_job* job = load_job_next < load_job_cnt ? &load_jobs[load_job_next++] : NULL;
+    pthread_mutex_unlock(&load_job_lock);
 
-  sprintf(command_str, "s %04X ", address);
+    if (job == NULL)
+      return NULL;
 
-  sprintf(nval, "%02X", val & 0xff);
-  strcat(command_str, nval);
-  strcat(command_str, " ");
+    long long start = gettime_us();
 
-  sprintf(nval, "%02X", (val >> 8) & 0xff);
-  strcat(command_str, nval);
-  strcat(command_str, " ");
+    load_job = job;
+    prior_offset = 0;
+    cur_func_info = NULL;
+    lstFuncInfo = NULL;
+    memset(&segmentOffsets, 0, sizeof(segmentOffsets));
+    lstModuleOffsets = NULL;
 
-  strcat(command_str, "\n");
+    load_debug_file_as(job->fname, job->origin, &calypsi_map_loaded);
 
-  serialWrite(command_str);
-  serialRead(inbuf, BUFSIZE);
+    job->segments = segmentOffsets;
+    job->modules = lstModuleOffsets;
+    job->funcs = lstFuncInfo;
+    job->cur_func = cur_func_info;
+    job->prior_offset = prior_offset;
+    job->us = gettime_us() - start;
+    job->done = true;
+    load_job = NULL;
+  }
 }
 
-// read all 16 at once (to hopefully speed things up for saving memory dumps)
-mem_data* get_mem28array(int addr)
+bool module_loaded(const char* name)
 {
-  static mem_data multimem[32];
-  mem_data* mem;
-  char str[100];
-  sprintf(str, "M%04X\n", addr);
-  serialWrite(str);
-  serialRead(inbuf, BUFSIZE);
-  char* strLine = strtok(inbuf, "\n");
-  for (int k = 0; k < 16; k++)
-  {
-    mem = &multimem[k];
-    sscanf(strLine, ":%X:%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
-    &mem->addr, &mem->b[0], &mem->b[1], &mem->b[2], &mem->b[3], &mem->b[4], &mem->b[5], &mem->b[6], &mem->b[7], &mem->b[8], &mem->b[9], &mem->b[10], &mem->b[11], &mem->b[12], &mem->b[13], &mem->b[14], &mem->b[15]);
-    strLine = strtok(NULL, "\n");
-  }
+  for (type_offsets* iter = lstModuleOffsets; iter != NULL; iter = iter->next)
+    if (strcmp(iter->modulename, name) == 0)
+      return true;
 
-  return multimem;
+  return false;
 }
 
-int parse_indices(char* str, int* x, int* y)
+// would 'job' have loaded any differently after the files before it?
+bool load_job_depends(type_load_job* job)
 {
-  int state = 0;
-  char s[100] = "";
-  int i=0;
+  if (job->serial)
+    return true;
+  if (job->used_prior_func && cur_func_info != NULL)
+    return true;
+  if (job->used_global_segments && segmentOffsets.seg_cnt != 0)
+    return true;
 
-  for (int k = 0; k < strlen(str); k++)
-  {
-    switch(state)
+  for (int k = 0; k < job->sym_name_cnt; k++)
+    if (symtab_find(&symMap, job->sym_names[k]) != NULL)
+      return true;
+
+  for (int k = 0; k < job->module_name_cnt; k++)
+    if (module_loaded(job->module_names[k]))
+      return true;
+
+  return false;
+}
+
+void cache_merge_tables(type_load_job* job);
+
+// adds what a worker (or the cache) loaded for 'job' to the global lists, as if
+// it had been loaded here
+void merge_load_job(type_load_job* job)
+{
+  if (job->log != NULL)
+    fputs(job->log, stdout);
+
+  if (job->cached_tables != NULL)
+    cache_merge_tables(job);
+  else
+  {
+    symtab_merge(&symMap, &job->symbols);
+    fileloc_merge(&fileLocs, &job->filelocs);
+  }
+
+  if (job->segments_loaded)
+    segmentOffsets = job->segments;
+
+  if (job->modules != NULL)
+  {
+    type_offsets** tail = &lstModuleOffsets;
+    while (*tail != NULL)
+      tail = &(*tail)->next;
+    *tail = job->modules;
+    job->modules = NULL;
+  }
+
+  while (job->funcs != NULL)
+  {
+    type_funcinfo* fi = job->funcs;
+    job->funcs = fi->next;
+    fi->next = NULL;
+    add_to_func_list(fi);
+  }
+  if (job->cur_func != NULL)
+  {
+    cur_func_info = job->cur_func;
+    prior_offset = job->prior_offset;
+  }
+}
+
+/**
+ * The debug-info cache: what each debug file loaded, as a worker left it in
+ * its job (see listSearch()), kept in DEBUG_CACHE_FILE in the working
+ * directory. A file whose record was made from the same versions (by mtime,
+ * to the nanosecond, and size) of it and the map/sym file that goes with it is
+ * loaded from the mmap'd record instead of being parsed again.
+ *
+ * It's a header, then a record per file (led by its length and a hash of
+ * it, so a damaged one is parsed again rather than trusted), each just a run
+ * of ints and strings (led by their length, including the nul, or 0 for a
+ * NULL), in the order cache_job() writes them. The lists in them refer to the
+ * record's own entries by index.
+ */
+#define DEBUG_CACHE_FILE ".m65dbg-cache"
+#define DEBUG_CACHE_MAGIC "m65dbgc2"
+
+typedef struct
+{
+  char* data;
+  int len;
+  int size;
+} type_cache_buf;
+
+typedef struct
+{
+  const char* p;
+  const char* end;
+  bool bad;       // ran off the end, or something didn't add up
+} type_cache_cursor;
+
+// FNV-1a
+unsigned int cache_hash(const char* p, int len)
+{
+  unsigned int h = 2166136261u;
+  for (int k = 0; k < len; k++)
+    h = (h ^ (unsigned char)p[k]) * 16777619u;
+  return h;
+}
+
+void cache_put(type_cache_buf* buf, const void* p, int len)
+{
+  if (buf->len + len > buf->size)
+  {
+    buf->size = (buf->len + len) * 2;
+    buf->data = realloc(buf->data, buf->size);
+  }
+  memcpy(buf->data + buf->len, p, len);
+  buf->len += len;
+}
+
+void cache_put_int(type_cache_buf* buf, int val)
+{
+  cache_put(buf, &val, sizeof(int));
+}
+
+void cache_put_ll(type_cache_buf* buf, long long val)
+{
+  cache_put(buf, &val, sizeof(long long));
+}
+
+void cache_put_str(type_cache_buf* buf, const char* s)
+{
+  int len = s != NULL ? strlen(s) + 1 : 0;
+  cache_put_int(buf, len);
+  cache_put(buf, s, len);
+}
+
+const char* cache_get(type_cache_cursor* cur, int len)
+{
+  if (len < 0 || cur->end - cur->p < len)
+  {
+    cur->bad = true;
+    return NULL;
+  }
+  const char* p = cur->p;
+  cur->p += len;
+  return p;
+}
+
+int cache_get_int(type_cache_cursor* cur)
+{
+  int val = 0;
+  const char* p = cache_get(cur, sizeof(int));
+  if (p != NULL)
+    memcpy(&val, p, sizeof(int));
+  return val;
+}
+
+long long cache_get_ll(type_cache_cursor* cur)
+{
+  long long val = 0;
+  const char* p = cache_get(cur, sizeof(long long));
+  if (p != NULL)
+    memcpy(&val, p, sizeof(long long));
+  return val;
+}
+
+// a string in the record (so "" if it's gone bad), or NULL
+const char* cache_get_str(type_cache_cursor* cur)
+{
+  int len = cache_get_int(cur);
+  const char* s = cache_get(cur, len);
+  if (len == 0)
+    return NULL;
+  if (s == NULL || s[len - 1] != '\0')
+  {
+    cur->bad = true;
+    return "";
+  }
+  return s;
+}
+
+// copies a name from the cache into 'dest' (of 'size' chars)
+void cache_get_name(type_cache_cursor* cur, char* dest, int size)
+{
+  const char* s = cache_get_str(cur);
+  if (s == NULL || strlen(s) >= size)
+    cur->bad = true;
+  else
+    strcpy(dest, s);
+}
+
+// notes the files the parse of 'job' reads (itself, and the map/symbol file
+// of the same name that the loaders look for), and their versions on disk, by
+// mtime and size (-1 if they're not there)
+void stamp_load_job(type_load_job* job)
+{
+  char* ext = strrchr(job->fname, '.');
+  const char* dep_ext = NULL;
+
+  snprintf(job->deps[0], sizeof(job->deps[0]), "%s", job->fname);
+  job->dep_cnt = 1;
+
+  if (strcmp(ext, ".list") == 0)
+    dep_ext = ".map";
+  else if (strcmp(ext, ".rep") == 0 || strcmp(ext, ".klist") == 0)
+    dep_ext = ".sym";
+  if (dep_ext != NULL)
+    snprintf(job->deps[job->dep_cnt++], sizeof(job->deps[0]), "%.*s%s", (int)(ext - job->fname), job->fname, dep_ext);
+
+  for (int k = 0; k < job->dep_cnt; k++)
+  {
+    struct stat st;
+    job->dep_mtime[k] = 0;
+    job->dep_size[k] = -1;
+    if (stat(job->deps[k], &st) == 0)
+    {
+      job->dep_mtime[k] = stat_mtime_ns(&st);
+      job->dep_size[k] = st.st_size;
+    }
+  }
+}
+
+// adds a record of what 'job' loaded to 'buf'
+void cache_job(type_cache_buf* buf, type_load_job* job)
+{
+  // (its length and hash go in front once they're known)
+  int start = buf->len;
+  cache_put_int(buf, 0);
+  cache_put_int(buf, 0);
+
+  cache_put_str(buf, job->fname);
+  cache_put_int(buf, job->dep_cnt);
+  for (int k = 0; k < job->dep_cnt; k++)
+  {
+    cache_put_str(buf, job->deps[k]);
+    cache_put_ll(buf, job->dep_mtime[k]);
+    cache_put_ll(buf, job->dep_size[k]);
+  }
+
+  cache_put_int(buf, job->used_prior_func);
+  cache_put_int(buf, job->used_global_segments);
+  cache_put_int(buf, job->prior_offset);
+  cache_put_str(buf, job->log);
+
+  cache_put_int(buf, job->sym_name_cnt);
+  for (int k = 0; k < job->sym_name_cnt; k++)
+    cache_put_str(buf, job->sym_names[k]);
+  cache_put_int(buf, job->module_name_cnt);
+  for (int k = 0; k < job->module_name_cnt; k++)
+    cache_put_str(buf, job->module_names[k]);
+
+  cache_put_int(buf, job->segments_loaded);
+  cache_put_int(buf, job->segments.seg_cnt);
+  for (int k = 0; k < job->segments.seg_cnt; k++)
+  {
+    cache_put_str(buf, job->segments.segments[k].name);
+    cache_put_int(buf, job->segments.segments[k].offset);
+  }
+
+  int module_cnt = 0;
+  for (type_offsets* mo = job->modules; mo != NULL; mo = mo->next)
+    module_cnt++;
+  cache_put_int(buf, module_cnt);
+  for (type_offsets* mo = job->modules; mo != NULL; mo = mo->next)
+  {
+    cache_put_str(buf, mo->modulename);
+    cache_put_int(buf, mo->enabled);
+    cache_put_int(buf, mo->seg_cnt);
+    for (int k = 0; k < mo->seg_cnt; k++)
+    {
+      cache_put_str(buf, mo->segments[k].name);
+      cache_put_int(buf, mo->segments[k].offset);
+    }
+  }
+
+  int func_cnt = 0, cur_func = -1;
+  for (type_funcinfo* fi = job->funcs; fi != NULL; fi = fi->next, func_cnt++)
+    if (fi == job->cur_func)
+      cur_func = func_cnt;
+  cache_put_int(buf, func_cnt);
+  cache_put_int(buf, cur_func);
+  for (type_funcinfo* fi = job->funcs; fi != NULL; fi = fi->next)
+  {
+    cache_put_str(buf, fi->name);
+    cache_put_int(buf, fi->addr);
+    cache_put_int(buf, fi->paramsize);
+    int local_cnt = 0;
+    for (type_localinfo* li = fi->locals; li != NULL; li = li->next)
+      local_cnt++;
+    cache_put_int(buf, local_cnt);
+    for (type_localinfo* li = fi->locals; li != NULL; li = li->next)
+    {
+      cache_put_str(buf, li->name);
+      cache_put_int(buf, li->offset);
+      cache_put_int(buf, li->size);
+    }
+  }
+
+  type_symmap_entry** entries = symtab_in_order(&job->symbols);
+  cache_put_int(buf, job->symbols.count);
+  for (int k = 0; k < job->symbols.count; k++)
+  {
+    cache_put_str(buf, entries[k]->symbol);
+    cache_put_int(buf, entries[k]->addr);
+    cache_put_str(buf, entries[k]->sval);
+  }
+  free(entries);
+
+  // (in the order they were added, as the job's lists are never looked up)
+  type_offsets* last_mo = NULL;
+  int last_idx = -1;
+  cache_put_int(buf, job->filelocs.count);
+  for (int k = 0; k < job->filelocs.count; k++)
+  {
+    type_fileloc* fl = job->filelocs.by_addr[k];
+    int module_idx = -1;
+
+    if (fl->module != NULL)
+    {
+      // (they're mostly from the one module as the one before)
+      if (last_mo == NULL || fl->module != last_mo->modulename)
+      {
+        last_idx = 0;
+        for (last_mo = job->modules; last_mo != NULL && fl->module != last_mo->modulename; last_mo = last_mo->next)
+          last_idx++;
+      }
+      if (last_mo != NULL)
+        module_idx = last_idx;
+    }
+
+    cache_put_int(buf, fl->addr);
+    cache_put_int(buf, fl->lastaddr);
+    cache_put_str(buf, fl->file);
+    cache_put_int(buf, module_idx);
+    cache_put_int(buf, fl->lineno);
+  }
+
+  int len = buf->len - start - 2 * sizeof(int);
+  unsigned int hash = cache_hash(buf->data + start + 2 * sizeof(int), len);
+  memcpy(buf->data + start, &len, sizeof(int));
+  memcpy(buf->data + start + sizeof(int), &hash, sizeof(int));
+}
+
+// was the record at 'cur' made from the versions of the files 'job' will read?
+bool cache_record_current(type_cache_cursor* cur, type_load_job* job)
+{
+  if (cache_get_int(cur) != job->dep_cnt)
+    return false;
+
+  for (int k = 0; k < job->dep_cnt && !cur->bad; k++)
+  {
+    const char* dep = cache_get_str(cur);
+    long long mtime = cache_get_ll(cur);
+    long long size = cache_get_ll(cur);
+
+    if (dep == NULL || strcmp(dep, job->deps[k]) != 0 ||
+        mtime != job->dep_mtime[k] || size != job->dep_size[k])
+      return false;
+  }
+
+  return !cur->bad;
+}
+
+/**
+ * reads the symbols and lines of a record (the rest of it, at 'cur'), adding
+ * them to 'symbols' and 'filelocs' if they're given, the way symtab_merge()
+ * and fileloc_merge() would have. 'modules' are the record's modules, which
+ * the lines refer to. Returns false if they don't add up.
+ */
+bool cache_read_tables(type_cache_cursor* cur, type_load_job* job, type_offsets** modules, int module_cnt,
+    type_symtab* symbols, type_filelocs* filelocs)
+{
+  int cnt = cache_get_int(cur);
+  for (int k = 0; k < cnt && !cur->bad; k++)
+  {
+    const char* symbol = cache_get_str(cur);
+    int addr = cache_get_int(cur);
+    const char* sval = cache_get_str(cur);
+    if (symbol == NULL || sval == NULL)
+      cur->bad = true;
+    else if (symbols != NULL)
+      symtab_add(symbols, symbol, addr, sval, job->origin);
+  }
+
+  cnt = cache_get_int(cur);
+  for (int k = 0; k < cnt && !cur->bad; k++)
+  {
+    type_fileloc fl = { 0 };
+    fl.addr = cache_get_int(cur);
+    fl.lastaddr = cache_get_int(cur);
+    fl.file = (char*)cache_get_str(cur);
+    int module_idx = cache_get_int(cur);
+    fl.lineno = cache_get_int(cur);
+    fl.origin = job->origin;
+
+    if (fl.file == NULL || module_idx < -1 || module_idx >= module_cnt)
+      cur->bad = true;
+    else if (filelocs != NULL)
+    {
+      fl.module = module_idx >= 0 ? modules[module_idx]->modulename : NULL;
+      type_fileloc* e = fileloc_add(filelocs, &fl);
+      if (fl.lastaddr != 0)
+        e->lastaddr = fl.lastaddr;
+    }
+  }
+
+  return !cur->bad && cur->p == cur->end;
+}
+
+// fills 'job' in from the rest of its record at 'cur', as if a worker had
+// loaded it. Returns false if the record doesn't add up.
+bool cache_load_job(type_load_job* job, type_cache_cursor* cur)
+{
+  job->used_prior_func = cache_get_int(cur);
+  job->used_global_segments = cache_get_int(cur);
+  job->prior_offset = cache_get_int(cur);
+  const char* log = cache_get_str(cur);
+  if (log != NULL)
+  {
+    job->log = strdup(log);
+    job->log_len = strlen(log);
+  }
+
+  int cnt = cache_get_int(cur);
+  for (int k = 0; k < cnt && !cur->bad; k++)
+  {
+    const char* name = cache_get_str(cur);
+    note_name(&job->sym_names, &job->sym_name_cnt, name != NULL ? name : "");
+  }
+  cnt = cache_get_int(cur);
+  for (int k = 0; k < cnt && !cur->bad; k++)
+  {
+    const char* name = cache_get_str(cur);
+    note_name(&job->module_names, &job->module_name_cnt, name != NULL ? name : "");
+  }
+
+  job->segments_loaded = cache_get_int(cur);
+  cnt = cache_get_int(cur);
+  if (cnt < 0 || cnt > 32)
+    return false;
+  for (int k = 0; k < cnt && !cur->bad; k++)
+  {
+    cache_get_name(cur, job->segments.segments[k].name, sizeof(job->segments.segments[k].name));
+    job->segments.segments[k].offset = cache_get_int(cur);
+  }
+  job->segments.seg_cnt = cnt;
+
+  // (kept in an array too, for the line entries that refer to them)
+  int module_cnt = cache_get_int(cur);
+  if (module_cnt < 0 || cur->bad)
+    return false;
+  type_offsets** modules = malloc((module_cnt + 1) * sizeof(type_offsets*));
+  type_offsets** mo_tail = &job->modules;
+  for (int k = 0; k < module_cnt; k++)
+  {
+    type_offsets* mo = calloc(1, sizeof(type_offsets));
+    *mo_tail = modules[k] = mo;
+    mo_tail = &mo->next;
+
+    cache_get_name(cur, mo->modulename, sizeof(mo->modulename));
+    mo->enabled = cache_get_int(cur);
+    mo->seg_cnt = cache_get_int(cur);
+    if (mo->seg_cnt < 0 || mo->seg_cnt > 32)
+      cur->bad = true;
+    for (int j = 0; j < mo->seg_cnt && !cur->bad; j++)
+    {
+      cache_get_name(cur, mo->segments[j].name, sizeof(mo->segments[j].name));
+      mo->segments[j].offset = cache_get_int(cur);
+    }
+    if (cur->bad)
+    {
+      module_cnt = k + 1;
+      break;
+    }
+  }
+
+  int func_cnt = cache_get_int(cur);
+  int cur_func = cache_get_int(cur);
+  type_funcinfo** fi_tail = &job->funcs;
+  for (int k = 0; k < func_cnt && !cur->bad; k++)
+  {
+    type_funcinfo* fi = calloc(1, sizeof(type_funcinfo));
+    *fi_tail = fi;
+    fi_tail = &fi->next;
+    if (k == cur_func)
+      job->cur_func = fi;
+
+    const char* name = cache_get_str(cur);
+    fi->name = strdup(name != NULL ? name : "");
+    fi->addr = cache_get_int(cur);
+    fi->paramsize = cache_get_int(cur);
+    int local_cnt = cache_get_int(cur);
+    type_localinfo** li_tail = &fi->locals;
+    for (int j = 0; j < local_cnt && !cur->bad; j++)
+    {
+      type_localinfo* li = calloc(1, sizeof(type_localinfo));
+      *li_tail = li;
+      li_tail = &li->next;
+
+      name = cache_get_str(cur);
+      li->name = strdup(name != NULL ? name : "");
+      li->offset = cache_get_int(cur);
+      li->size = cache_get_int(cur);
+    }
+  }
+
+  free(modules);
+  if (cur->bad)
+    return false;
+
+  // (the symbols and lines go straight into the global lists, if it's merged)
+  job->cached_tables = cur->p;
+  return cache_read_tables(cur, job, NULL, module_cnt, NULL, NULL);
+}
+
+// adds the symbols and lines of the cached 'job' to the global lists
+void cache_merge_tables(type_load_job* job)
+{
+  type_cache_cursor cur = { job->cached_tables, job->cached + job->cached_len, false };
+  int module_cnt = 0;
+
+  for (type_offsets* mo = job->modules; mo != NULL; mo = mo->next)
+    module_cnt++;
+  type_offsets** modules = malloc((module_cnt + 1) * sizeof(type_offsets*));
+  module_cnt = 0;
+  for (type_offsets* mo = job->modules; mo != NULL; mo = mo->next)
+    modules[module_cnt++] = mo;
+
+  cache_read_tables(&cur, job, modules, module_cnt, &symMap, &fileLocs);
+  free(modules);
+}
+
+// maps the cache in, if it's there. Returns its number of records.
+int cache_open(const char** data, int* len)
+{
+  struct stat st;
+  int fd = open(DEBUG_CACHE_FILE, O_RDONLY);
+
+  *data = NULL;
+  *len = 0;
+  if (fd < 0)
+    return 0;
+
+  if (fstat(fd, &st) == 0 && st.st_size > strlen(DEBUG_CACHE_MAGIC) + sizeof(int))
+  {
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED)
+    {
+      *data = p;
+      *len = st.st_size;
+    }
+  }
+  close(fd);
+
+  if (*data == NULL)
+    return 0;
+
+  type_cache_cursor cur = { *data, *data + *len, false };
+  const char* magic = cache_get(&cur, strlen(DEBUG_CACHE_MAGIC));
+  int rec_cnt = cache_get_int(&cur);
+  if (memcmp(magic, DEBUG_CACHE_MAGIC, strlen(DEBUG_CACHE_MAGIC)) != 0 || rec_cnt < 0)
+  {
+    munmap((void*)*data, *len);
+    *data = NULL;
+    *len = 0;
+    return 0;
+  }
+  return rec_cnt;
+}
+
+// fills in each job that has a current record in the cache.
+// Returns how many did.
+int cache_load_jobs(const char* data, int len, int rec_cnt)
+{
+  int loaded = 0;
+  type_cache_cursor cur = { data + strlen(DEBUG_CACHE_MAGIC) + sizeof(int), data + len, false };
+
+  for (int k = 0; k < rec_cnt; k++)
+  {
+    int rec_len = cache_get_int(&cur);
+    unsigned int hash = cache_get_int(&cur);
+    const char* rec = cache_get(&cur, rec_len);
+    if (rec == NULL)
+      break;
+
+    type_cache_cursor rec_cur = { rec, rec + rec_len, false };
+    const char* fname = cache_get_str(&rec_cur);
+    if (fname == NULL)
+      continue;
+
+    for (int j = 0; j < load_job_cnt; j++)
+    {
+      type_load_job* job = &load_jobs[j];
+      if (job->serial || job->done || strcmp(job->fname, fname) != 0)
+        continue;
+
+      if (!cache_record_current(&rec_cur, job) || cache_hash(rec, rec_len) != hash)
+        break;
+
+      if (cache_load_job(job, &rec_cur))
+      {
+        job->done = true;
+        job->cached = rec - 2 * sizeof(int);
+        job->cached_len = rec_len + 2 * sizeof(int);
+        loaded++;
+      }
+      else
+      {
+        // (it's parsed instead)
+        discard_load_job(job);
+      }
+      break;
+    }
+  }
+
+  return loaded;
+}
+
+// writes out the records in 'buf' as the cache (if it can)
+void cache_write(type_cache_buf* buf, int rec_cnt)
+{
+  FILE* f = fopen(DEBUG_CACHE_FILE ".tmp", "wb");
+  if (f == NULL)
+    return;
+
+  bool ok = fwrite(DEBUG_CACHE_MAGIC, strlen(DEBUG_CACHE_MAGIC), 1, f) == 1;
+  ok = ok && fwrite(&rec_cnt, sizeof(int), 1, f) == 1;
+  ok = ok && (buf->len == 0 || fwrite(buf->data, buf->len, 1, f) == 1);
+  ok = fclose(f) == 0 && ok;
+
+  if (!ok || rename(DEBUG_CACHE_FILE ".tmp", DEBUG_CACHE_FILE) != 0)
+    unlink(DEBUG_CACHE_FILE ".tmp");
+}
+
+/**
+ * search the current directory for *.list files (and the other debug files).
+ *
+ * Big projects have lots of them, so they're parsed on a few worker threads,
+ * each into tables of its own, then merged in the order they were found, so
+ * that symbols defined more than once resolve the same as when they were
+ * loaded one after the other. Any file whose parse depended on what the files
+ * before it loaded (and the .clst files, which share the one .cmap) is just
+ * loaded again in its turn.
+ *
+ * Those tables are kept in the debug-info cache, so the files that haven't
+ * changed since the last time don't need parsing at all.
+ */
+void listSearch(void)
+{
+  bool calypsi_map_loaded = false;
+  DIR           *d;
+  struct dirent *dir;
+  long long start = gettime_us();
+
+  d = opendir(".");
+  if (d)
+  {
+    while ((dir = readdir(d)) != NULL)
+    {
+      if (!is_debug_file(dir->d_name))
+        continue;
+
+      load_jobs = realloc(load_jobs, (load_job_cnt + 1) * sizeof(type_load_job));
+      type_load_job* job = &load_jobs[load_job_cnt++];
+      memset(job, 0, sizeof(type_load_job));
+      job->fname = strdup(dir->d_name);
+      job->origin = debug_file_origin(dir->d_name);
+      job->serial = strcmp(get_extension(dir->d_name), ".clst") == 0;
+    }
+
+    closedir(d);
+  }
+
+  // the ones that haven't changed come from the cache
+  const char* cache_data;
+  int cache_len;
+  int cache_cnt = cache_open(&cache_data, &cache_len);
+  int cached_cnt = 0;
+
+  for (int k = 0; k < load_job_cnt; k++)
+    if (!load_jobs[k].serial)
+      stamp_load_job(&load_jobs[k]);
+  if (cache_data != NULL)
+    cached_cnt = cache_load_jobs(cache_data, cache_len, cache_cnt);
+
+  int parse_cnt = 0;
+  for (int k = 0; k < load_job_cnt; k++)
+    if (!load_jobs[k].serial && !load_jobs[k].done)
+      parse_cnt++;
+
+  int thread_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+  if (thread_cnt > LOAD_THREADS_MAX)
+    thread_cnt = LOAD_THREADS_MAX;
+  if (thread_cnt > parse_cnt)
+    thread_cnt = parse_cnt;
+
+  // (even for just the one, so that what it loads can go in the cache)
+  if (thread_cnt > 0)
+  {
+    pthread_t threads[LOAD_THREADS_MAX];
+    int started = 0;
+
+    load_job_next = 0;
+    for (int k = 0; k < thread_cnt; k++)
+      if (pthread_create(&threads[started], NULL, load_worker, NULL) == 0)
+        started++;
+    for (int k = 0; k < started; k++)
+      pthread_join(threads[k], NULL);
+    thread_cnt = started;
+  }
+
+  type_cache_buf cache = { 0 };
+  int cache_rec_cnt = 0;
+
+  for (int k = 0; k < load_job_cnt; k++)
+  {
+    type_load_job* job = &load_jobs[k];
+    bool in_order = !job->done || load_job_depends(job);
+
+    // what it loaded by itself goes in the cache, whether it's used or not
+    if (job->done && !job->serial)
+    {
+      if (job->cached != NULL)
+        cache_put(&cache, job->cached, job->cached_len);
+      else
+        cache_job(&cache, job);
+      cache_rec_cnt++;
+    }
+
+    if (in_order)
+    {
+      discard_load_job(job);
+      long long file_start = gettime_us();
+      load_debug_file_as(job->fname, job->origin, &calypsi_map_loaded);
+      job->us = gettime_us() - file_start;
+    }
+    else
+    {
+      merge_load_job(job);
+      discard_load_job(job);
+    }
+
+    if (load_verbose)
+    {
+      if (job->cached != NULL && !in_order)
+        printf("- loaded \"%s\" from the cache\n", job->fname);
+      else
+        printf("- parsed \"%s\" in %.1fms%s\n", job->fname, job->us / 1000.0,
+          in_order && job->done ? " (in order)" : "");
+    }
+
+    free(job->fname);
+  }
+
+  // anything changed?
+  if (cache_rec_cnt != cached_cnt || cache_cnt != cached_cnt)
+    cache_write(&cache, cache_rec_cnt);
+  free(cache.data);
+  if (cache_data != NULL)
+    munmap((void*)cache_data, cache_len);
+
+  if (load_verbose)
+    printf("- loaded %d debug files (%d from the cache) in %.1fms (%d worker threads)\n", load_job_cnt,
+      cached_cnt, (gettime_us() - start) / 1000.0, thread_cnt);
+
+  free(load_jobs);
+  load_jobs = NULL;
+  load_job_cnt = 0;
+}
+
+// parses the line after the header of the 'r' command's output, eg:
+// "E0A8 00 00 00 00 00 01F9 0000 0000 A8 00 00 ..E...Z."
+// returns false if it's short of any fields
+bool parse_reg_line(const char* line, reg_data* reg)
+{
+  static const int widths[12] = { 4, 2, 2, 2, 2, 2, 4, 4, 4, 2, 2, 2 };
+  int v[12];
+
+  int n = monparse_hex_fields(&line, widths, 12, v);
+
+  // fill in as many as we got, the way sscanf would have
+  int* fields[12] = { &reg->pc, &reg->a, &reg->x, &reg->y, &reg->z, &reg->b,
+    &reg->sp, &reg->maph, &reg->mapl, &reg->lastop, &reg->odd1, &reg->odd2 };
+  for (int k = 0; k < n; k++)
+    *fields[k] = v[k];
+
+  if (n < 12)
+    return false;
+
+  return monparse_word(&line, reg->flags, sizeof(reg->flags)) > 0;
+}
+
+reg_data get_regs(void)
+{
+  reg_data reg = { 0 };
+  char* line;
+  while (1) {
+    serialWrite("r\n");
+    serialRead(inbuf, BUFSIZE);
+    line = strstr(inbuf+2, "\n");
+    if (!line) // did we hit a null+1? try again
+      continue;
+    line++;
+    parse_reg_line(line, &reg);
+    break;
+  }
+
+  return reg;
+}
+
+void show_regs(reg_data* reg)
+{
+  printf("PC   A  X  Y  Z  B  SP   MAPH MAPL LAST-OP     P  P-FLAGS   RGP uS IO\n");
+  printf("%04X %02X %02X %02X %02X %02X %04X %04X %04X %02X       %02X %02X %s\n", reg->pc, reg->a, reg->x, reg->y, reg->z, reg->b, reg->sp, reg->maph, reg->mapl, reg->lastop, reg->odd1, reg->odd2, reg->flags);
+  printf("     ");
+  print_char(reg->a);
+  printf("  ");
+  print_char(reg->x);
+  printf("  ");
+  print_char(reg->y);
+  printf("  ");
+  print_char(reg->z);
+  printf("\n");
+}
+
+// parses a ":AAAAAAAA:" + 16 hex pairs memory line into 'mem'
+// (leaving it untouched if the line is short or malformed)
+bool parse_mem_line(char* line, mem_data* mem)
+{
+  uint32_t addr;
+  uint8_t bytes[16];
+  int len = 0;
+
+  if (line == NULL)
+    return false;
+
+  while (len < MEM_LINE_LEN && line[len] != '\0')
+    len++;
+
+  if (monparse_mem_line(line, len, &addr, bytes) < 0)
+    return false;
+
+  mem->addr = addr;
+  for (int k = 0; k < 16; k++)
+    mem->b[k] = bytes[k];
+  return true;
+}
+
+void format_mem_cmd(char* str, int addr, bool useAddr28)
+{
+  if (useAddr28)
+    sprintf(str, "m%07X\n", addr); // use 'm' (for 28-bit memory addresses)
+  else
+    sprintf(str, "m777%04X\n", addr); // set upper 12-bis to $777xxxx (for memory in cpu context)
+}
+
+// ---------------------------------------------------------------------------
+// target memory cache
+//
+// While the cpu is stopped, its memory only changes when we change it, so what
+// get_mem(), get_mem_lines() and bulk_read() fetch is kept here and served to
+// the next command too, rather than dis, watches, locals and the backtrace each
+// going back to the monitor for the same bytes.
+//
+// The cache is a sparse page table over the whole 28-bit address space (chip
+// ram, attic ram, rom, and the cpu's view of memory as $777xxxx), of 256-byte
+// pages with a valid bit per 16-byte row. Pages are only allocated as they're
+// read, and the least recently used ones are dropped once the cache reaches its
+// size limit (see 'memcache').
+//
+// Every command sent to the monitor that could change memory (a poke, load,
+// step, go, t0/t1, reset or raw command) bumps mem_epoch (see serial.c), which
+// makes all the ram pages stale. While the cpu is running, they only last for
+// the m65dbg command being run. Rom pages stay valid across that, until the rom
+// is loaded, reset or made writable. The i/o area is never cached.
+
+#define MEM_CACHE_BULK_MAX 4096     // bigger bulk_read()s use the helper, if it's on
+#define MEM_CACHE_CHUNK (64*256)    // mem_cache_read() fetches this much at a time
+#define MEM_CACHE_MIN_KB 64
+
+#define MEM_REGION_RAM 0
+#define MEM_REGION_ROM 1
+#define MEM_REGION_IO  2
+
+typedef struct mcp
+{
+  int addr;             // of the page's first byte
+  int epoch;            // the mem_epoch (or rom_epoch) it was filled in
+  bool rom;             // holds read-only rom, so follows rom_epoch
+  unsigned int valid;   // a bit per 16-byte row
+  struct mcp* prev;     // lru list, most recently used first
+  struct mcp* next;
+  unsigned char b[256];
+} mem_cache_page;
+
+// 4096 directories (addr >> 16), each of 256 pages, allocated as needed
+mem_cache_page** mem_cache_dir[4096] = { NULL };
+
+mem_cache_page* mem_cache_mru = NULL;
+mem_cache_page* mem_cache_lru = NULL;
+int mem_cache_pages = 0;
+int mem_cache_max_pages = 4096; // 1MB
+int mem_cache_hits = 0;
+int mem_cache_misses = 0;
+
+// rows queued up to be fetched by the next mem_cache_run()
+int mem_cache_queued[SERIAL_QUEUE_MAX];
+int mem_cache_queued_cnt = 0;
+
+int mem_cache_key(int addr, bool useAddr28)
+{
+  if (useAddr28)
+    return addr & 0xfffffff;
+  return 0x7770000 | (addr & 0xffff); // the cpu's view of memory
+}
+
+int mem_region(int key)
+{
+  // the i/o registers can change even while the cpu is stopped
+  if (key >= 0xffd0000 && key <= 0xffdffff)
+    return MEM_REGION_IO;
+  if ((key & 0xffff000) == 0x777d000)
+    return MEM_REGION_IO;
+  if (key >= 0x20000 && key <= 0x3ffff)
+    return MEM_REGION_ROM;
+  return MEM_REGION_RAM;
+}
+
+bool mem_cacheable(int key)
+{
+  return mem_region(key) != MEM_REGION_IO;
+}
+
+// whether none of 'count' bytes from 'key' fall in the i/o area
+bool mem_range_cacheable(int key, int count)
+{
+  for (int a = key & ~0xfff; a < key + count; a += 0x1000)
+    if (!mem_cacheable(a < key ? key : a))
+      return false;
+  return mem_cacheable(key + count - 1);
+}
+
+mem_cache_page* mem_cache_find(int key)
+{
+  mem_cache_page** dir = mem_cache_dir[(key >> 16) & 0xfff];
+  if (dir == NULL)
+    return NULL;
+  return dir[(key >> 8) & 0xff];
+}
+
+bool mem_cache_current(mem_cache_page* pg)
+{
+  if (pg->rom)
+    return pg->epoch == rom_epoch;
+  return pg->epoch == mem_epoch;
+}
+
+void mem_cache_unlink(mem_cache_page* pg)
+{
+  if (pg->prev)
+    pg->prev->next = pg->next;
+  else
+    mem_cache_mru = pg->next;
+  if (pg->next)
+    pg->next->prev = pg->prev;
+  else
+    mem_cache_lru = pg->prev;
+}
+
+void mem_cache_touch(mem_cache_page* pg)
+{
+  if (pg == mem_cache_mru)
+    return;
+  mem_cache_unlink(pg);
+  pg->prev = NULL;
+  pg->next = mem_cache_mru;
+  if (mem_cache_mru)
+    mem_cache_mru->prev = pg;
+  mem_cache_mru = pg;
+  if (mem_cache_lru == NULL)
+    mem_cache_lru = pg;
+}
+
+// takes the least recently used page out of the table, and hands it back for reuse
+mem_cache_page* mem_cache_evict(void)
+{
+  mem_cache_page* pg = mem_cache_lru;
+  mem_cache_unlink(pg);
+  mem_cache_dir[(pg->addr >> 16) & 0xfff][(pg->addr >> 8) & 0xff] = NULL;
+  mem_cache_pages--;
+  return pg;
+}
+
+// drops pages until the cache is within its size limit
+void mem_cache_trim(void)
+{
+  while (mem_cache_pages > mem_cache_max_pages)
+    free(mem_cache_evict());
+}
+
+// returns the (current) page holding 'key', adding an empty one if need be
+mem_cache_page* mem_cache_get(int key)
+{
+  mem_cache_page* pg = mem_cache_find(key);
+
+  if (pg == NULL)
+  {
+    mem_cache_page*** dir = &mem_cache_dir[(key >> 16) & 0xfff];
+    if (*dir == NULL)
+      *dir = (mem_cache_page**)calloc(256, sizeof(mem_cache_page*));
+
+    if (mem_cache_pages >= mem_cache_max_pages)
+      pg = mem_cache_evict();
+    else
+      pg = (mem_cache_page*)malloc(sizeof(mem_cache_page));
+
+    pg->addr = key & ~0xff;
+    pg->valid = 0;
+    pg->prev = NULL;
+    pg->next = mem_cache_mru;
+    if (mem_cache_mru)
+      mem_cache_mru->prev = pg;
+    mem_cache_mru = pg;
+    if (mem_cache_lru == NULL)
+      mem_cache_lru = pg;
+    (*dir)[(key >> 8) & 0xff] = pg;
+    mem_cache_pages++;
+  }
+  else
+    mem_cache_touch(pg);
+
+  if (pg->valid == 0 || !mem_cache_current(pg))
+  {
+    pg->rom = mem_region(key) == MEM_REGION_ROM && !romw;
+    pg->epoch = pg->rom ? rom_epoch : mem_epoch;
+    pg->valid = 0;
+  }
+  return pg;
+}
+
+bool mem_cache_has_row(int row)
+{
+  mem_cache_page* pg = mem_cache_find(row);
+  return pg != NULL && mem_cache_current(pg) &&
+    (pg->valid & (1 << ((row >> 4) & 0x0f)));
+}
+
+void mem_cache_put_row(int row, unsigned int* b)
+{
+  mem_cache_page* pg = mem_cache_get(row);
+  for (int k = 0; k < 16; k++)
+    pg->b[(row & 0xf0) + k] = b[k];
+  pg->valid |= 1 << ((row >> 4) & 0x0f);
+}
+
+void mem_cache_handler(int idx, char* response, void* ctx)
+{
+  int row = mem_cache_queued[idx];
+  char* strLine = strtok(response, "\n");
+  for (; strLine != NULL; strLine = strtok(NULL, "\n"))
+  {
+    mem_data mem;
+    if (!parse_mem_line(strLine, &mem))
+      continue;
+    mem_cache_put_row(row, mem.b);
+    row += 16;
+  }
+}
+
+// fetches everything queued by mem_cache_queue(), in one pipelined batch
+void mem_cache_run(void)
+{
+  if (mem_cache_queued_cnt == 0)
+    return;
+  serialQueueRun(mem_cache_handler, NULL);
+  mem_cache_queued_cnt = 0;
+}
+
+// queues up the fetch of a 16-byte row ('m'), or of a whole 256-byte page ('M')
+void mem_cache_queue(int row, bool whole_page)
+{
+  char str[100];
+
+  if (mem_cache_queued_cnt == SERIAL_QUEUE_MAX)
+    mem_cache_run();
+
+  mem_cache_queued[mem_cache_queued_cnt++] = row;
+  sprintf(str, whole_page ? "M%07X\n" : "m%07X\n", row);
+  serialQueue(str);
+}
+
+// ---------------------------------------------------------------------------
+// persistent rom image
+//
+// The rom ($20000-$3FFFF) only changes when a new one is flashed, so a copy of
+// it is kept on disk (in ~/.cache/m65dbg), named after a fingerprint of a few
+// sampled pages and its version string. The first read of the rom after
+// connecting (or after a reset or load) fetches just those pages, and if a
+// copy matches, the rom is read from it from then on. If none does, the whole
+// rom is fetched once and saved. Once 'romw 1' has been used, the rom may
+// have been patched, so the copies on disk aren't trusted for the rest of the
+// session.
+
+#define ROM_START 0x20000
+#define ROM_SIZE  0x20000
+
+unsigned char rom_image[ROM_SIZE];
+int rom_image_epoch = -1;     // the rom_epoch the target's rom was last fingerprinted in
+bool rom_image_valid = false; // rom_image matches the target's rom
+bool rom_image_dirty = false; // the rom has been writable, so may not match any copy
+
+// the pages sampled for the fingerprint (the first holds the version string)
+int rom_sample_pages[] = { 0x20000, 0x24000, 0x2a000, 0x2e000, 0x32000, 0x3a000, 0x3e000, 0x3ff00, 0 };
+
+// builds the path of a file in m65dbg's cache directory, creating it if need be
+bool get_cache_path(char* path, int size, const char* fname)
+{
+  char* base = getenv("XDG_CACHE_HOME");
+  char dir[256];
+
+  if (base != NULL && base[0] != '\0')
+    snprintf(dir, sizeof(dir), "%s", base);
+  else if (getenv("HOME") != NULL)
+    snprintf(dir, sizeof(dir), "%s/.cache", getenv("HOME"));
+  else
+    return false;
+
+  mkdir(dir, 0755);
+  strncat(dir, "/m65dbg", sizeof(dir) - strlen(dir) - 1);
+  mkdir(dir, 0755);
+
+  snprintf(path, size, "%s/%s", dir, fname);
+  return true;
+}
+
+// the rom's version string (eg, "V920377"), or "" if it doesn't have one
+void rom_version(unsigned char* page0, char* version)
+{
+  int k = 0;
+
+  if (page0[0x16] == 'V')
+    for (; k < 7 && isalnum(page0[0x16 + k]); k++)
+      version[k] = page0[0x16 + k];
+  version[k] = '\0';
+}
+
+// fetches the sampled pages, and works out the name of the rom's copy on disk
+void rom_image_fingerprint(char* fname)
+{
+  static mem_data lines[16];
+  unsigned char page0[256];
+  char version[8];
+  unsigned long long hash = 14695981039346656037ULL; // fnv-1a
+
+  for (int k = 0; rom_sample_pages[k] != 0; k++)
+  {
+    get_mem28blocks(rom_sample_pages[k], 1, lines);
+    for (int i = 0; i < 256; i++)
+    {
+      unsigned char c = lines[i / 16].b[i % 16];
+      if (k == 0)
+        page0[i] = c;
+      hash = (hash ^ c) * 1099511628211ULL;
+    }
+  }
+
+  rom_version(page0, version);
+  for (int k = 0; version[k] != '\0'; k++)
+    hash = (hash ^ version[k]) * 1099511628211ULL;
+
+  if (version[0] != '\0')
+    sprintf(fname, "rom-%s-%016llx.bin", version, hash);
+  else
+    sprintf(fname, "rom-%016llx.bin", hash);
+}
+
+// fetches the whole rom into rom_image
+bool rom_image_fetch(void)
+{
+  static mem_data lines[64*16];
+
+  if (helper_reads && helper_read_mem(ROM_START, ROM_SIZE, rom_image) == 0)
+    return true;
+
+  for (int addr = ROM_START; addr < ROM_START + ROM_SIZE; addr += 64*256)
+  {
+    get_mem28blocks(addr, 64, lines);
+    for (int k = 0; k < 64*256; k++)
+      rom_image[addr - ROM_START + k] = lines[k / 16].b[k % 16];
+
+    if (ctrlcflag)
+      return false;
+  }
+  return true;
+}
+
+// makes sure rom_image is checked against the target's rom, since it was last
+// reset or loaded
+void rom_image_check(void)
+{
+  char fname[64];
+  char path[512];
+
+  if (rom_image_epoch == rom_epoch)
+    return;
+  rom_image_epoch = rom_epoch;
+  rom_image_valid = false;
+  if (rom_image_dirty)
+    return;
+
+  mem_cache_run();  // it shares the command queue
+
+  rom_image_fingerprint(fname);
+  if (!get_cache_path(path, sizeof(path), fname))
+    return;
+
+  FILE* f = fopen(path, "rb");
+  if (f != NULL)
+  {
+    rom_image_valid = fread(rom_image, 1, ROM_SIZE, f) == ROM_SIZE;
+    fclose(f);
+    if (rom_image_valid)
+      return;
+  }
+
+  printf("Caching the rom in '%s'...\n", path);
+  if (!rom_image_fetch())
+    return;
+  rom_image_valid = true;
+
+  f = fopen(path, "wb");
+  if (f == NULL)
+  {
+    printf("Could not write '%s'\n", path);
+    return;
+  }
+  fwrite(rom_image, 1, ROM_SIZE, f);
+  fclose(f);
+}
+
+// fills the cache's row at 'row' from the rom image, if it's in the rom and
+// the image can be trusted (see rom_image_check())
+bool rom_image_fill(int row)
+{
+  if (row < ROM_START || row >= ROM_START + ROM_SIZE || romw || rom_image_dirty)
+    return false;
+
+  if (!rom_image_valid)
+    return false;
+
+  mem_cache_page* pg = mem_cache_get(row);
+  memcpy(&pg->b[row & 0xf0], &rom_image[row - ROM_START], 16);
+  pg->valid |= 1 << ((row >> 4) & 0x0f);
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// on-target page checksums
+//
+// After a step, every ram page in the cache is stale, even though most of them
+// won't have changed. With 'pagesums' on, when a read (or the watches) would
+// need to refetch enough stale pages that the cache has whole copies of, a
+// small routine (see pagesum.a65) is put in a scratch area of the target's
+// memory and run over them instead. It hands back a 3-byte checksum per page,
+// and only the pages whose checksum differs from the cached copy get fetched.
+// The scratch area, the PC and the registers are put back afterwards. (The
+// routine masks interrupts once it starts, so the debuggee's handlers can't
+// run while it's there, bar one taken on its very first instruction.)
+
+#define PAGESUM_MIN_PAGES 8     // below this, it's cheaper to just fetch them
+#define PAGESUM_MAX_PAGES 128   // per run, so the scratch area is 1KB at most
+#define PAGESUM_POLLS 100
+
+extern unsigned int pagesumroutine_len;
+extern unsigned char pagesumroutine[];
+extern int pagesumroutine_relocs[];
+extern int pagesumroutine_entry;
+extern int pagesumroutine_idle;
+
+bool pagesums = false;
+int pagesum_scratch = 0xc000;   // the (page aligned) cpu address the routines borrow
+
+// the same sums pagesum.a65 works out
+void pagesum_calc(unsigned char* b, unsigned char* sum)
+{
+  unsigned int s1 = 0, s2 = 0, s3 = 0;
+
+  for (int k = 0; k < 256; k++)
+  {
+    s1 += b[k];
+    s1 = (s1 & 0xff) + (s1 >> 8);
+    s2 += s1;
+    s2 = (s2 & 0xff) + (s2 >> 8);
+    s3 += s2;
+    s3 = (s3 & 0xff) + (s3 >> 8);
+  }
+  sum[0] = s1;
+  sum[1] = s2;
+  sum[2] = s3;
+}
+
+// writes 'count' bytes to a 28-bit address, via binary 'l' uploads
+void put_mem28(int addr, unsigned char* buf, int count)
+{
+  char str[100];
+
+  poke_buffer_flush();
+
+  while (count > 0)
+  {
+    // the end address only has 16 bits, so don't cross a 64KB boundary
+    int n = 0x10000 - (addr & 0xffff);
+    if (n > count)
+      n = count;
+    if (n > 4096)
+      n = 4096;
+
+    sprintf(str, "l%X %X\n", addr, (addr + n) & 0xffff);
+    serialFlush();
+    serialNoteCommand(str, strlen(str));
+    transport_write_command(monitor_link, str, strlen(str));
+    transport_write_payload(monitor_link, buf, n);
+
+    addr += n;
+    buf += n;
+    count -= n;
+  }
+}
+
+// whether the page at 'addr' could be in the scratch area, which won't hold
+// what it did while the routine is there (bank 0 is usually what the cpu sees)
+bool pagesum_scratch_page(int addr)
+{
+  int ofs = addr & 0xffff;
+  if ((addr & 0xfff0000) == 0x7770000 || addr < 0x10000)
+    if (ofs >= pagesum_scratch && ofs < pagesum_scratch + 0x100 + PAGESUM_MAX_PAGES*6)
+      return true;
+  return false;
+}
+
+// whether a stale page is worth checksumming, rather than just refetching
+bool pagesum_candidate(mem_cache_page* pg)
+{
+  if (pg == NULL || mem_cache_current(pg) || pg->rom || pg->valid != 0xffff)
+    return false;
+
+  return !pagesum_scratch_page(pg->addr);
+}
+
+// puts the 'size' bytes of 'image' (a routine that can run from any page, see
+// pagesum.c and unlz.c, along with its variables) at the scratch area, having
+// saved what was there, and lets the cpu run it from 'entry' until it reaches
+// 'idle', checking up to 'polls' times. The routine spins there with interrupts
+// still masked, and once the cpu is stopped, the PLP that follows the idle loop
+// is stepped to put P back. The scratch area is then read back into 'image',
+// and the memory and the PC are put back. Returns false (having said why) if
+// the routine couldn't be put there, or didn't finish.
+bool scratch_run(const char* name, unsigned char* image, int size, int entry, int idle, int polls)
+{
+  static mem_data lines[4*16];
+  static unsigned char saved[1024];
+  char str[100];
+  int base = 0x7770000 | pagesum_scratch;
+  int blocks = (size + 255) / 256;
+  bool finished = false;
+
+  reg_data reg = get_regs();
+
+  get_mem28blocks(base, blocks, lines);
+  for (int k = 0; k < blocks*256; k++)
+    saved[k] = lines[k / 16].b[k % 16];
+
+  put_mem28(base, image, size);
+
+  // make sure it's there, before pointing the cpu at it
+  get_mem28blocks(base, 1, lines);
+  for (int k = 0; k < 256 && k < size; k++)
+  {
+    if (lines[k / 16].b[k % 16] != image[k])
+    {
+      printf("%s: couldn't put the routine at $%04X (is it ram?)\n", name, pagesum_scratch);
+      put_mem28(base, saved, size);
+      return false;
+    }
+  }
+
+  sprintf(str, "g%X\n", pagesum_scratch + entry);
+  serialWrite(str);
+  serialRead(inbuf, BUFSIZE);
+  serialWrite("t0\n");
+  serialRead(inbuf, BUFSIZE);
+
+  for (int k = 0; k < polls && !finished; k++)
+  {
+    usleep(1000);
+    finished = get_regs().pc == pagesum_scratch + idle;
+  }
+
+  serialWrite("t1\n");
+  serialRead(inbuf, BUFSIZE);
+
+  if (finished)
+  {
+    sprintf(str, "g%X\n", pagesum_scratch + idle + 3);
+    serialWrite(str);
+    serialRead(inbuf, BUFSIZE);
+    step();
+
+    get_mem28blocks(base, blocks, lines);
+    for (int k = 0; k < size; k++)
+      image[k] = lines[k / 16].b[k % 16];
+  }
+
+  sprintf(str, "g%X\n", reg.pc);
+  serialWrite(str);
+  serialRead(inbuf, BUFSIZE);
+  put_mem28(base, saved, size);
+
+  if (!finished)
+  {
+    printf("%s: the routine didn't finish\n", name);
+    return false;
+  }
+  return true;
+}
+
+// runs the routine over the 'n' pages at 'page_addrs' (28-bit or $777xxxx,
+// up to PAGESUM_MAX_PAGES of them), and hands back their checksums in 'sums',
+// 3 bytes each. Returns false if the routine couldn't be run (and turns
+// pagesums off).
+bool pagesum_target(int* page_addrs, int n, unsigned char* sums)
+{
+  static unsigned char image[1024];
+  int list = pagesum_scratch + 0x100;
+  int results = list + n*3;
+  int size = 0x100 + n*6;
+
+  memset(image, 0, size);
+  memcpy(&image[pagesumroutine_entry], pagesumroutine, pagesumroutine_len);
+  for (int k = 0; pagesumroutine_relocs[k] >= 0; k++)
+    image[pagesumroutine_entry + pagesumroutine_relocs[k]] = pagesum_scratch >> 8;
+  image[7] = n;
+  image[8] = list & 0xff;
+  image[9] = list >> 8;
+  image[10] = results & 0xff;
+  image[11] = results >> 8;
+  for (int k = 0; k < n; k++)
+  {
+    int addr = page_addrs[k];
+    image[0x100 + k*3 + 0] = addr >> 8;
+    image[0x100 + k*3 + 1] = (addr & 0xfff0000) == 0x7770000 ? 0x00 : addr >> 16;
+    image[0x100 + k*3 + 2] = (addr & 0xfff0000) == 0x7770000 ? 0xff : addr >> 24;
+  }
+
+  if (!scratch_run("pagesums", image, size, pagesumroutine_entry, pagesumroutine_idle, PAGESUM_POLLS))
+  {
+    printf(" - pagesums is turned off.\n");
+    pagesums = false;
+    return false;
+  }
+
+  memcpy(sums, &image[results - pagesum_scratch], n*3);
+  return true;
+}
+
+// runs the routine over 'n' pages, and makes those that haven't changed
+// current again. Returns false if the routine couldn't be run.
+bool pagesum_run(mem_cache_page** pages, int n)
+{
+  int page_addrs[PAGESUM_MAX_PAGES];
+  unsigned char sums[PAGESUM_MAX_PAGES*3];
+
+  for (int k = 0; k < n; k++)
+    page_addrs[k] = pages[k]->addr;
+  if (!pagesum_target(page_addrs, n, sums))
+    return false;
+
+  // (after all the commands the routine took, which made everything stale again)
+  for (int k = 0; k < n; k++)
+  {
+    unsigned char sum[3];
+
+    pagesum_calc(pages[k]->b, sum);
+    if (memcmp(sum, &sums[k*3], 3) == 0)
+      pages[k]->epoch = mem_epoch;
+  }
+  return true;
+}
+
+// checksums the stale pages among the 'n' given, if there are enough of them
+void pagesum_revalidate(int* page_addrs, int n)
+{
+  static mem_cache_page* pages[SERIAL_QUEUE_MAX];
+  int cnt = 0;
+
+  if (!pagesums || cpu_running || helper_running)
+    return;
+
+  for (int k = 0; k < n && cnt < SERIAL_QUEUE_MAX; k++)
+  {
+    mem_cache_page* pg = mem_cache_find(page_addrs[k]);
+    if (!pagesum_candidate(pg))
+      continue;
+
+    bool dup = false;
+    for (int i = 0; i < cnt && !dup; i++)
+      dup = pages[i] == pg;
+    if (!dup)
+      pages[cnt++] = pg;
+  }
+
+  if (cnt < PAGESUM_MIN_PAGES)
+    return;
+
+  mem_cache_run();  // it shares the command queue
+
+  for (int k = 0; k < cnt; k += PAGESUM_MAX_PAGES)
+  {
+    int batch = cnt - k > PAGESUM_MAX_PAGES ? PAGESUM_MAX_PAGES : cnt - k;
+    if (!pagesum_run(&pages[k], batch))
+      break;
+  }
+}
+
+// reads 'count' bytes at 'key' (a 28-bit or $777xxxx address) through the cache,
+// fetching whatever rows it doesn't have in one go. Bulk reads (of a page or
+// more) fetch each page they're missing rows of as a single 'M' block, as do
+// smaller reads of a page the cache doesn't have at all.
+void mem_cache_read(int key, unsigned char* buf, int count)
+{
+  poke_buffer_flush();
+
+  // a chunk at a time, so the pages fetched can't push each other out
+  while (count > MEM_CACHE_CHUNK)
+  {
+    mem_cache_read(key, buf, MEM_CACHE_CHUNK);
+    key += MEM_CACHE_CHUNK;
+    buf += MEM_CACHE_CHUNK;
+    count -= MEM_CACHE_CHUNK;
+  }
+
+  int first = key & ~0x0f;
+  int last = (key + count - 1) & ~0x0f;
+  bool bulk = count >= 256;
+
+  if (key < ROM_START + ROM_SIZE && key + count > ROM_START && !romw)
+    rom_image_check();
+
+  if (pagesums && count >= PAGESUM_MIN_PAGES*256)
+  {
+    int page_addrs[MEM_CACHE_CHUNK/256 + 1];
+    int n = 0;
+    for (int page = key & ~0xff; page <= ((key + count - 1) & ~0xff); page += 256)
+      page_addrs[n++] = page;
+    pagesum_revalidate(page_addrs, n);
+  }
+
+  for (int row = first; row <= last; )
+  {
+    mem_cache_page* pg = mem_cache_find(row);
+    bool page_empty = pg == NULL || pg->valid == 0 || !mem_cache_current(pg);
+
+    if (mem_cache_has_row(row) || rom_image_fill(row))
+    {
+      mem_cache_hits++;
+      row += 16;
+    }
+    else if ((row & 0xff) == 0 && row + 0xf0 <= last && page_empty)
+    {
+      mem_cache_misses += 16;
+      mem_cache_queue(row, true);
+      row += 256;
+    }
+    else if (bulk)
+    {
+      // fetch the rest of the page in one go, rows we already have and all
+      int page = row & ~0xff;
+      int end = last < page + 0xf0 ? last : page + 0xf0;
+      mem_cache_misses += (end - row) / 16 + 1;
+      mem_cache_queue(page, true);
+      row = page + 256;
+    }
+    else
+    {
+      mem_cache_misses++;
+      mem_cache_queue(row, false);
+      row += 16;
+    }
+  }
+  mem_cache_run();
+
+  for (int k = 0; k < count; k++)
+  {
+    int addr = key + k;
+    mem_cache_page* pg = mem_cache_find(addr);
+    if (mem_cache_has_row(addr & ~0x0f))
+    {
+      buf[k] = pg->b[addr & 0xff];
+      mem_cache_touch(pg);
+    }
+    else
+      buf[k] = 0;
+  }
+}
+
+mem_data get_mem(int addr, bool useAddr28)
+{
+  mem_data mem = { 0 };
+  char str[100];
+
+  int key = mem_cache_key(addr, useAddr28);
+  if (mem_range_cacheable(key, 16))
+  {
+    unsigned char bytes[16];
+    mem_cache_read(key, bytes, 16);
+    mem.addr = key;
+    for (int k = 0; k < 16; k++)
+      mem.b[k] = bytes[k];
+    return mem;
+  }
+
+  format_mem_cmd(str, addr, useAddr28);
+
+  serialWrite(str);
+  serialRead(inbuf, BUFSIZE);
+  parse_mem_line(inbuf, &mem);
+
+  return mem;
+}
+
+void get_mem_lines_handler(int idx, char* response, void* ctx)
+{
+  mem_data* lines = (mem_data*)ctx;
+  parse_mem_line(response, &lines[idx]);
+}
+
+// reads 'count' consecutive 16-byte lines, with the 'm' commands all
+// pipelined instead of paying a round trip per line
+void get_mem_lines(int addr, int count, bool useAddr28, mem_data* lines)
+{
+  char str[100];
+
+  int key = mem_cache_key(addr, useAddr28);
+  if (mem_range_cacheable(key, count*16))
+  {
+    static unsigned char bytes[SERIAL_QUEUE_MAX*16];
+    while (count > 0)
+    {
+      int n = count > SERIAL_QUEUE_MAX ? SERIAL_QUEUE_MAX : count;
+      mem_cache_read(key, bytes, n*16);
+      for (int k = 0; k < n; k++)
+      {
+        lines[k].addr = key + k*16;
+        for (int i = 0; i < 16; i++)
+          lines[k].b[i] = bytes[k*16 + i];
+      }
+      key += n*16;
+      lines += n;
+      count -= n;
+    }
+    return;
+  }
+
+  while (count > 0)
+  {
+    int n = count > SERIAL_QUEUE_MAX ? SERIAL_QUEUE_MAX : count;
+
+    memset(lines, 0, n * sizeof(mem_data));
+    for (int k = 0; k < n; k++)
+    {
+      format_mem_cmd(str, addr + k*16, useAddr28);
+      serialQueue(str);
+    }
+    serialQueueRun(get_mem_lines_handler, lines);
+
+    addr += n*16;
+    lines += n;
+    count -= n;
+  }
+}
+
+void get_mem28blocks_handler(int idx, char* response, void* ctx)
+{
+  mem_data* lines = &((mem_data*)ctx)[idx*16];
+  char* strLine = strtok(response, "\n");
+  for (int k = 0; k < 16 && strLine != NULL; k++)
+  {
+    parse_mem_line(strLine, &lines[k]);
+    strLine = strtok(NULL, "\n");
+  }
+}
+
+// reads 'blocks' consecutive 256-byte blocks (16 lines each) via pipelined 'M' commands
+void get_mem28blocks(int addr, int blocks, mem_data* lines)
+{
+  char str[100];
+
+  while (blocks > 0)
+  {
+    int n = blocks > SERIAL_QUEUE_MAX ? SERIAL_QUEUE_MAX : blocks;
+
+    memset(lines, 0, n * 16 * sizeof(mem_data));
+    for (int k = 0; k < n; k++)
+    {
+      sprintf(str, "M%07X\n", addr + k*256);
+      serialQueue(str);
+    }
+    serialQueueRun(get_mem28blocks_handler, lines);
+
+    addr += n*256;
+    lines += n*16;
+    blocks -= n;
+  }
+}
+
+// how many bytes bulk_read() fetches per batch of 'M' commands
+#define BULK_BATCH (64*256)
+
+// reads 'count' bytes from a 28-bit address through the cache, unless it'd fill
+// over half the cache or the helper could do it faster. Otherwise it's read via
+// the helper's binary read job if it's in use (see 'fastread'), or else via
+// pipelined 'M' commands
+void bulk_read(int addr, unsigned char* buf, int count)
+{
+  static mem_data lines[BULK_BATCH/16];
+
+  if (mem_range_cacheable(addr & 0xfffffff, count) && count <= mem_cache_max_pages * 128 &&
+      (count <= MEM_CACHE_BULK_MAX || !helper_reads))
+  {
+    mem_cache_read(addr & 0xfffffff, buf, count);
+    return;
+  }
+
+  if (helper_reads && helper_read_mem(addr, count, buf) == 0)
+    return;
+
+  while (count > 0)
+  {
+    int n = count > BULK_BATCH ? BULK_BATCH : count;
+    int nlines = (n + 15) / 16;
+
+    // small reads are cheaper as single lines than as whole 'M' blocks
+    if (n < 256)
+      get_mem_lines(addr, nlines, true, lines);
+    else
+      get_mem28blocks(addr, (n + 255) / 256, lines);
+
+    for (int k = 0; k < n; k++)
+      buf[k] = lines[k / 16].b[k % 16];
+
+    addr += n;
+    buf += n;
+    count -= n;
+
+    if (ctrlcflag)
+      break;
+  }
+}
+
+// rows noted by prefetch_add(), for the next prefetch_run() to fetch
+int prefetch_rows[SERIAL_QUEUE_MAX];
+int prefetch_rows_cnt = 0;
+
+// notes a line (ie, a watch) for the next prefetch_run(), so that they can
+// all be fetched into the cache in one pipelined batch
+void prefetch_add(int addr, bool useAddr28)
+{
+  int key = mem_cache_key(addr, useAddr28);
+
+  if (!mem_cacheable(key))
+    return;
+
+  for (int row = key & ~0x0f; row <= ((key + 15) & ~0x0f); row += 16)
+  {
+    bool noted = false;
+    for (int k = 0; k < prefetch_rows_cnt && !noted; k++)
+      noted = prefetch_rows[k] == row;
+    if (!noted && prefetch_rows_cnt < SERIAL_QUEUE_MAX)
+      prefetch_rows[prefetch_rows_cnt++] = row;
+  }
+}
+
+void prefetch_run(void)
+{
+  poke_buffer_flush();
+  pagesum_revalidate(prefetch_rows, prefetch_rows_cnt);
+
+  for (int k = 0; k < prefetch_rows_cnt; k++)
+    if (!mem_cache_has_row(prefetch_rows[k]) && !rom_image_fill(prefetch_rows[k]))
+      mem_cache_queue(prefetch_rows[k], false);
+  prefetch_rows_cnt = 0;
+
+  mem_cache_run();
+}
+
+// ---------------------------------------------------------------------------
+// write buffer
+//
+// poke(), pokew(), set_mem(), put_mem28array(), set_palette_entry() and the
+// poke commands don't each send an 's' command and wait for its prompt, but
+// add their bytes to this buffer, where writes to adjacent addresses are merged
+// into runs. It's flushed before anything else goes out to the monitor (see
+// serialWrite() and serialQueue()), before any read through the memory cache,
+// and before m65dbg waits for the next command, so the target never appears
+// out of date. Ram runs of POKE_BUFFER_UPLOAD_MIN bytes or more go up as binary
+// 'l' uploads, everything else as pipelined 's' lines of up to 16 bytes.
+//
+// A write is only merged over an earlier one in the same run of ram. Writes to
+// the i/o area (and rom) are only appended to the run before them, so they all
+// still reach the target once each, in the order they were made.
+
+#define POKE_BUFFER_RUNS 256
+#define POKE_BUFFER_SIZE 65536
+#define POKE_BUFFER_UPLOAD_MIN 64
+
+typedef struct
+{
+  int key;    // 28-bit or $777xxxx address of the first byte
+  int len;
+  int ofs;    // of its bytes in poke_buffer_data[]
+} poke_run;
+
+poke_run poke_buffer_runs[POKE_BUFFER_RUNS];
+int poke_buffer_cnt = 0;
+unsigned char poke_buffer_data[POKE_BUFFER_SIZE];
+int poke_buffer_used = 0;
+
+// sends all the pending writes to the target
+void poke_buffer_flush(void)
+{
+  char str[128];
+  int cnt = poke_buffer_cnt;
+
+  if (cnt == 0)
+    return;
+
+  // empty it first, as the commands below come back through here
+  poke_buffer_cnt = 0;
+  poke_buffer_used = 0;
+
+  for (int k = 0; k < cnt; k++)
+  {
+    poke_run* run = &poke_buffer_runs[k];
+    unsigned char* b = &poke_buffer_data[run->ofs];
+
+    if (run->len >= POKE_BUFFER_UPLOAD_MIN && mem_range_cacheable(run->key, run->len) &&
+        mem_region(run->key) == MEM_REGION_RAM && mem_region(run->key + run->len - 1) == MEM_REGION_RAM)
+    {
+      // the 's' lines queued so far have to go first
+      serialQueueRun(NULL, NULL);
+      put_mem28(run->key, b, run->len);
+      continue;
+    }
+
+    for (int i = 0; i < run->len; i += 16)
+    {
+      int n = run->len - i > 16 ? 16 : run->len - i;
+      int len = sprintf(str, "s%07X", run->key + i);
+      for (int j = 0; j < n; j++)
+        len += sprintf(&str[len], " %02X", b[i + j]);
+
+      if (serialQueueLength() == SERIAL_QUEUE_MAX)
+        serialQueueRun(NULL, NULL);
+      serialQueue(str);
+    }
+  }
+  serialQueueRun(NULL, NULL);
+}
+
+// adds a write of 'count' bytes at 'key' (a 28-bit or $777xxxx address) to the buffer
+void poke_buffer_add(int key, unsigned char* buf, int count)
+{
+  // too big to buffer, so don't
+  if (count > POKE_BUFFER_SIZE)
+  {
+    poke_buffer_flush();
+    while (count > 0)
+    {
+      int n = count > POKE_BUFFER_SIZE ? POKE_BUFFER_SIZE : count;
+      poke_buffer_add(key, buf, n);
+      poke_buffer_flush();
+      key += n;
+      buf += n;
+      count -= n;
+    }
+    return;
+  }
+
+  if (poke_buffer_cnt > 0)
+  {
+    poke_run* last = &poke_buffer_runs[poke_buffer_cnt - 1];
+
+    // over bytes already in the last run (of ram)?
+    if (key >= last->key && key + count <= last->key + last->len &&
+        mem_range_cacheable(key, count) && mem_region(key) == MEM_REGION_RAM &&
+        mem_region(key + count - 1) == MEM_REGION_RAM)
+    {
+      memcpy(&poke_buffer_data[last->ofs + key - last->key], buf, count);
+      return;
+    }
+
+    // straight after it? (its bytes are the last in poke_buffer_data[])
+    if (key == last->key + last->len && poke_buffer_used + count <= POKE_BUFFER_SIZE)
+    {
+      memcpy(&poke_buffer_data[poke_buffer_used], buf, count);
+      poke_buffer_used += count;
+      last->len += count;
+      return;
+    }
+  }
+
+  if (poke_buffer_cnt == POKE_BUFFER_RUNS || poke_buffer_used + count > POKE_BUFFER_SIZE)
+    poke_buffer_flush();
+
+  poke_run* run = &poke_buffer_runs[poke_buffer_cnt++];
+  run->key = key;
+  run->len = count;
+  run->ofs = poke_buffer_used;
+  memcpy(&poke_buffer_data[poke_buffer_used], buf, count);
+  poke_buffer_used += count;
+}
+
+int peek(unsigned int address)
+{
+  mem_data mem = get_mem(address, false);
+  return mem.b[0];
+}
+
+int mpeek(unsigned int address)
+{
+  mem_data mem = get_mem(address, true);
+  return mem.b[0];
+}
+
+int mpeekw(unsigned int address)
+{
+  mem_data mem = get_mem(address, true);
+  return mem.b[0] + (mem.b[1] << 8);
+}
+
+void poke(unsigned int address, int val)
+{
+  unsigned char b = val;
+
+  poke_buffer_add(mem_cache_key(address, true), &b, 1);
+}
+
+void pokew(unsigned int address, int val)
+{
+  unsigned char b[2] = { val & 0xff, (val >> 8) & 0xff };
+
+  poke_buffer_add(mem_cache_key(address, true), b, 2);
+}
+
+// read all 16 at once (to hopefully speed things up for saving memory dumps)
+mem_data* get_mem28array(int addr)
+{
+  static mem_data multimem[32];
+  mem_data* mem;
+  char str[100];
+  sprintf(str, "M%04X\n", addr);
+  serialWrite(str);
+  serialRead(inbuf, BUFSIZE);
+  char* strLine = strtok(inbuf, "\n");
+  for (int k = 0; k < 16; k++)
+  {
+    mem = &multimem[k];
+    parse_mem_line(strLine, mem);
+    strLine = strtok(NULL, "\n");
+  }
+
+  return multimem;
+}
+
+int parse_indices(char* str, int* x, int* y)
+{
+  int state = 0;
+  char s[100] = "";
+  int i=0;
+
+  for (int k = 0; k < strlen(str); k++)
+  {
+    switch(state)
     {
       case 0: // expect [
         if (str[k] == '[')
@@ -3204,21 +5153,14 @@ void set_palette_entry(int idx, int val)
   int g = (val >> 8) & 0xff;
   int b = val & 0xff;
 
-  char str[128];
-  int tmp = ( (r & 0x0f) << 4) + ( (r & 0xf0) >> 4);
-  sprintf(str, "s%X %x\n", 0xffd3100 + idx, tmp);
-  serialWrite(str);
-  serialRead(inbuf, BUFSIZE);
+  unsigned char tmp = ( (r & 0x0f) << 4) + ( (r & 0xf0) >> 4);
+  poke_buffer_add(0xffd3100 + idx, &tmp, 1);
 
   tmp = ( (g & 0x0f) << 4) + ( (g & 0xf0) >> 4);
-  sprintf(str, "s%X %x\n", 0xffd3200 + idx, tmp);
-  serialWrite(str);
-  serialRead(inbuf, BUFSIZE);
+  poke_buffer_add(0xffd3200 + idx, &tmp, 1);
 
   tmp = ( (b & 0x0f) << 4) + ( (b & 0xf0) >> 4);
-  sprintf(str, "s%X %x\n", 0xffd3300 + idx, tmp);
-  serialWrite(str);
-  serialRead(inbuf, BUFSIZE);
+  poke_buffer_add(0xffd3300 + idx, &tmp, 1);
 }
 
 void cmdPalette(void)
@@ -3297,33 +5239,12 @@ void clearListsAndMaps(void)
 
   lstCalypsiChunkInfo = NULL;
 
-  type_fileloc* iterF = lstFileLoc;
-  type_fileloc* curFileLoc;
-
-  while (iterF != NULL) {
-    curFileLoc = iterF;
-    iterF = iterF->next;
-
-    free(curFileLoc->file);
-    free(curFileLoc);
-  }
-
-  lstFileLoc = NULL;
+  fileloc_clear(&fileLocs);
+  cur_file_loc = NULL;
+  srcfile_clear(&srcFiles);
 
   // clear map data
-  type_symmap_entry* iterS = lstSymMap;
-  type_symmap_entry* curSym = NULL;
-
-  while (iterS != NULL) {
-    curSym = iterS;
-    iterS = iterS->next;
-
-    free(curSym->sval);
-    free(curSym->symbol);
-    free(curSym);
-  }
-
-  lstSymMap = NULL;
+  symtab_clear(&symMap);
 }
 
 
@@ -3468,9 +5389,8 @@ void cmd_poke(int size, bool is_addr28)
   if (!is_addr28)
     addr28 += 0x7770000;
 
-  sprintf(outbuf, "s%08X", addr28);
-
-  char str[10] = "";
+  unsigned char bytes[256];
+  int cnt = 0;
   char * strVal;
   unsigned long val;
 
@@ -3484,8 +5404,7 @@ void cmd_poke(int size, bool is_addr28)
       memval = oldmemval;
       set_field(&memval, bfi.start_bit, bfi.num_bits, val);
 
-      sprintf(str, " %X", memval & 0xff);
-      strcat(outbuf, str);
+      bytes[cnt++] = memval & 0xff;
       printf("\x1b[38;2;255;0;0mBEFORE: $%02X : %%%s\n", oldmemval, toBinaryString(oldmemval, &bfi));
       printf("\x1b[38;2;0;255;0m AFTER: $%02X : %%%s%s\n", memval, toBinaryString(memval, &bfi), KNRM);
     }
@@ -3495,17 +5414,16 @@ void cmd_poke(int size, bool is_addr28)
     {
       val = get_sym_value(strVal);
 
-      for (int k = 0; k < size; k++)
+      for (int k = 0; k < size && cnt < (int)sizeof(bytes); k++)
       {
-        sprintf(str, " %lX", val & 0xff);
-        strcat(outbuf, str);
+        bytes[cnt++] = val & 0xff;
         val >>= 8;
       }
     }
   }
 
-  serialWrite(outbuf);
-  serialRead(inbuf, BUFSIZE);
+  if (cnt > 0)
+    poke_buffer_add(addr28 & 0xfffffff, bytes, cnt);
 }
 
 void cmdPoke(void)
@@ -3547,20 +5465,7 @@ void cmdMPokeQ(void)
 // write buffer to client ram
 void put_mem28array(int addr, unsigned char* data, int size)
 {
-  char str[10];
-  sprintf(outbuf, "s%08X", addr);
-
-  int i = 0;
-  while(i < size)
-  {
-    sprintf(str, " %02X", data[i]);
-    strcat(outbuf, str);
-    i++;
-  }
-  strcat(outbuf, "\n");
-
-  serialWrite(outbuf);
-  serialRead(inbuf, BUFSIZE);
+  poke_buffer_add(addr & 0xfffffff, data, size);
 }
 
 void cmdRawHelp(void)
@@ -3661,32 +5566,44 @@ void print_char(int c)
   }
 }
 
+// how many lines dump()/mdump() pipeline in one go
+#define DUMP_BATCH 256
+
 void dump(int addr, int total)
 {
+  mem_data lines[DUMP_BATCH];
   int cnt = 0;
   while (cnt < total)
   {
-    // get memory at current pc
-    mem_data mem = get_mem(addr + cnt, false);
+    // fetch the next batch of lines in one go
+    int nlines = (total - cnt + 15) / 16;
+    if (nlines > DUMP_BATCH)
+      nlines = DUMP_BATCH;
+    get_mem_lines(addr + cnt, nlines, false, lines);
 
-    printf(" :%07X ", mem.addr);
-    for (int k = 0; k < 16; k++)
+    for (int l = 0; l < nlines; l++)
     {
-      if (k == 8) // add extra space prior to 8th byte
-        printf(" ");
+      mem_data mem = lines[l];
 
-      printf("%02X ", mem.b[k]);
-    }
+      printf(" :%07X ", mem.addr);
+      for (int k = 0; k < 16; k++)
+      {
+        if (k == 8) // add extra space prior to 8th byte
+          printf(" ");
 
-    printf(" | ");
+        printf("%02X ", mem.b[k]);
+      }
 
-    for (int k = 0; k < 16; k++)
-    {
-      int c = mem.b[k];
-      print_char(c);
+      printf(" | ");
+
+      for (int k = 0; k < 16; k++)
+      {
+        int c = mem.b[k];
+        print_char(c);
+      }
+      printf("\n");
+      cnt+=16;
     }
-    printf("\n");
-    cnt+=16;
 
     if (ctrlcflag)
       break;
@@ -3718,38 +5635,47 @@ void cmdDump(void)
 
 void mdump(int addr, int total)
 {
+  unsigned char bytes[DUMP_BATCH*16];
   int cnt = 0;
   while (cnt < total)
   {
-    // get memory at current pc
-    mem_data mem = get_mem(addr + cnt, true);
+    // fetch the next batch of lines in one go
+    int nlines = (total - cnt + 15) / 16;
+    if (nlines > DUMP_BATCH)
+      nlines = DUMP_BATCH;
+    bulk_read(addr + cnt, bytes, nlines * 16);
 
-    printf(" :%07X ", mem.addr);
-    for (int k = 0; k < 16; k++)
+    for (int l = 0; l < nlines; l++)
     {
-      if (k == 8) // add extra space prior to 8th byte
-        printf(" ");
+      unsigned char* b = &bytes[l * 16];
 
-      if (cnt+k >= total) {
-        printf("   ");
-        continue;
-      }
+      printf(" :%07X ", addr + cnt);
+      for (int k = 0; k < 16; k++)
+      {
+        if (k == 8) // add extra space prior to 8th byte
+          printf(" ");
 
-      printf("%02X ", mem.b[k]);
-    }
+        if (cnt+k >= total) {
+          printf("   ");
+          continue;
+        }
+
+        printf("%02X ", b[k]);
+      }
 
-    printf(" | ");
+      printf(" | ");
 
-    for (int k = 0; k < 16; k++)
-    {
-      if (cnt+k == total)
-        break;
+      for (int k = 0; k < 16; k++)
+      {
+        if (cnt+k == total)
+          break;
 
-      int c = mem.b[k];
-      print_char(c);
+        int c = b[k];
+        print_char(c);
+      }
+      printf("\n");
+      cnt+=16;
     }
-    printf("\n");
-    cnt+=16;
 
     if (ctrlcflag)
       break;
@@ -3782,12 +5708,19 @@ void cmdMDump(void)
 // return the last byte count
 int disassemble_addr_into_string(char* str, int addr, bool useAddr28)
 {
-  int last_bytecount = 0;
-  char s[32] = { 0 };
-
   // get memory at current pc
   mem_data mem = get_mem(addr, useAddr28);
 
+  return disassemble_mem_into_string(str, addr, useAddr28, &mem);
+}
+
+// disassembles the instruction at the start of an already fetched line of memory
+int disassemble_mem_into_string(char* str, int addr, bool useAddr28, mem_data* pmem)
+{
+  int last_bytecount = 0;
+  char s[32] = { 0 };
+  mem_data mem = *pmem;
+
   // now, try to disassemble it
 
   // Program counter
@@ -4006,9 +5939,32 @@ void disassemble(bool useAddr28)
 
   int idx = 0;
 
+  // prefetch the memory for the listing in pipelined batches (an instruction
+  // is at most 3 bytes), rather than a round trip per instruction
+  static mem_data lines[DUMP_BATCH];
+  int lines_addr = 0;
+  int lines_len = 0; // bytes held in lines[]
+
   while (idx < cnt)
   {
-    last_bytecount = disassemble_addr_into_string(str, addr, useAddr28);
+    if (addr < lines_addr || addr + 3 > lines_addr + lines_len)
+    {
+      int nlines = ((cnt - idx) * 3 + 15) / 16;
+      if (nlines > DUMP_BATCH)
+        nlines = DUMP_BATCH;
+      get_mem_lines(addr, nlines, useAddr28, lines);
+      lines_addr = addr;
+      lines_len = nlines * 16;
+    }
+
+    // gather the bytes at addr into a line of their own
+    mem_data mem = { 0 };
+    int ofs = addr - lines_addr;
+    mem.addr = addr;
+    for (int k = 0; k < 16 && ofs + k < lines_len; k++)
+      mem.b[k] = lines[(ofs + k) / 16].b[(ofs + k) % 16];
+
+    last_bytecount = disassemble_mem_into_string(str, addr, useAddr28, &mem);
 
     // print from .list ref? (i.e., find source in .a65 file?)
     if (idx == 0)
@@ -4086,6 +6042,157 @@ void cmdBackwardDis(void)
   disassemble(false);
 }
 
+// ---------------------------------------------------------------------------
+// on-target dma
+//
+// mcopy and mfill don't pass the memory through m65dbg, but put a list of
+// enhanced dma jobs (in F018A format, with the megabyte options for 28-bit
+// addresses) in chip ram at DMA_LIST_ADDR, and have the cpu trigger it with a
+// write to $D705 (see call_temp_routine()). What was at DMA_LIST_ADDR is put
+// back afterwards.
+//
+// Each job stays within a 64KB bank of its source and destination. Anything
+// the dma can't do (the cpu's view at $777xxxx, the i/o area, a copy up into
+// an overlapping range, or a range over the list itself) is done through
+// m65dbg instead, with bulk reads and writes.
+
+#define DMA_LIST_ADDR 0xc000
+#define DMA_JOB_LEN 17        // 6 bytes of options and an 11-byte job
+#define DMA_JOBS_MAX 64       // per trigger
+#define DMA_JOB_MAX 0x8000    // bytes per job
+
+#define DMA_CMD_COPY  0x00
+#define DMA_CMD_FILL  0x03
+#define DMA_CMD_CHAIN 0x04
+
+// whether the dma can reach all of 'count' bytes from 'addr' (a 28-bit address)
+bool dma_reachable(int addr, int count)
+{
+  if ((addr & 0xfff0000) == 0x7770000 || ((addr + count - 1) & 0xfff0000) == 0x7770000)
+    return false;
+  if (addr < DMA_LIST_ADDR + DMA_JOBS_MAX*DMA_JOB_LEN && addr + count > DMA_LIST_ADDR)
+    return false;
+  return mem_range_cacheable(addr, count);
+}
+
+// fills in a job at 'p' of 'count' bytes to 'dst', from 'src' (or of 'src', if a fill)
+void dma_make_job(unsigned char* p, int cmd, int src, int dst, int count)
+{
+  p[0] = 0x0a;                // F018A format
+  p[1] = 0x80;                // source megabyte
+  p[2] = cmd == DMA_CMD_FILL ? 0 : src >> 20;
+  p[3] = 0x81;                // destination megabyte
+  p[4] = dst >> 20;
+  p[5] = 0x00;                // end of options
+  p[6] = cmd;
+  p[7] = count & 0xff;
+  p[8] = count >> 8;
+  p[9] = src & 0xff;
+  p[10] = (src >> 8) & 0xff;
+  p[11] = (src >> 16) & 0x0f;
+  p[12] = dst & 0xff;
+  p[13] = (dst >> 8) & 0xff;
+  p[14] = (dst >> 16) & 0x0f;
+  p[15] = 0;                  // modulo
+  p[16] = 0;
+}
+
+// copies (or fills, with 'src' as the byte) 'count' bytes to 'dst' with the
+// target's dma, a list of up to DMA_JOBS_MAX jobs at a time
+void dma_run(int cmd, int src, int dst, int count)
+{
+  static unsigned char list[DMA_JOBS_MAX * DMA_JOB_LEN];
+  static unsigned char saved[DMA_JOBS_MAX * DMA_JOB_LEN];
+  int total = count;
+  char str[32];
+
+  stop_cpu_if_running();
+
+  if (dst < ROM_START + ROM_SIZE && dst + count > ROM_START)
+  {
+    rom_epoch++;
+    rom_image_dirty = true;
+  }
+
+  while (count > 0)
+  {
+    int len = 0;
+
+    for (int jobs = 0; jobs < DMA_JOBS_MAX && count > 0; jobs++)
+    {
+      int n = count > DMA_JOB_MAX ? DMA_JOB_MAX : count;
+      if (n > 0x10000 - (dst & 0xffff))
+        n = 0x10000 - (dst & 0xffff);
+      if (cmd == DMA_CMD_COPY && n > 0x10000 - (src & 0xffff))
+        n = 0x10000 - (src & 0xffff);
+
+      if (jobs > 0)
+        list[len - DMA_JOB_LEN + 6] |= DMA_CMD_CHAIN;
+      dma_make_job(&list[len], cmd, src, dst, n);
+      len += DMA_JOB_LEN;
+
+      if (cmd == DMA_CMD_COPY)
+        src += n;
+      dst += n;
+      count -= n;
+    }
+
+    bulk_read(DMA_LIST_ADDR, saved, len);
+    put_mem28(DMA_LIST_ADDR, list, len);
+
+    // the list's address, apart from the low byte, which triggers it
+    unsigned char regs[2] = { (DMA_LIST_ADDR >> 8) & 0xff, (DMA_LIST_ADDR >> 16) & 0x7f };
+    unsigned char mb = DMA_LIST_ADDR >> 20;
+    poke_buffer_add(0xffd3701, regs, 2);
+    poke_buffer_add(0xffd3704, &mb, 1);
+
+    sprintf(str, "lda #$%02x", DMA_LIST_ADDR & 0xff);
+    char* trigger_routine[] = { "pha", str, "sta $d705", "pla", NULL };
+    call_temp_routine(trigger_routine);
+
+    put_mem28(DMA_LIST_ADDR, saved, len);
+
+    printf("%d%%...\r", (int)(100LL * (total - count) / total));
+    fflush(stdout);
+
+    if (ctrlcflag)
+      break;
+  }
+  printf("\n");
+}
+
+// the same as dma_run(), but through m65dbg, for what the dma can't reach
+void host_copy(int cmd, int src, int dst, int count)
+{
+  static unsigned char buf[BULK_BATCH];
+  int total = count;
+
+  // a copy up into an overlapping range has to go from the end backwards
+  bool backwards = cmd == DMA_CMD_COPY && dst > src && dst < src + count;
+
+  if (cmd == DMA_CMD_FILL)
+    memset(buf, src, sizeof(buf));
+
+  while (count > 0)
+  {
+    int n = count > BULK_BATCH ? BULK_BATCH : count;
+    int ofs = backwards ? count - n : total - count;
+
+    if (cmd == DMA_CMD_COPY)
+      bulk_read(src + ofs, buf, n);
+    put_mem28array(dst + ofs, buf, n);
+    poke_buffer_flush();
+    count -= n;
+
+    printf("%d%%...\r", (int)(100LL * (total - count) / total));
+    fflush(stdout);
+
+    if (ctrlcflag)
+      break;
+  }
+  printf("\n");
+}
+
 void cmdMCopy(void)
 {
   // get address from parameter?
@@ -4097,7 +6204,7 @@ void cmdMCopy(void)
     return;
   }
 
-  int src_addr = get_sym_value(token);
+  int src_addr = get_sym_value(token) & 0xfffffff;
 
   token = strtok(NULL, " ");
 
@@ -4107,7 +6214,7 @@ void cmdMCopy(void)
     return;
   }
 
-  int dest_addr = get_sym_value(token);
+  int dest_addr = get_sym_value(token) & 0xfffffff;
 
   token = strtok(NULL, " ");
 
@@ -4118,31 +6225,54 @@ void cmdMCopy(void)
   }
 
   int count = get_sym_value(token);
+  if (count <= 0)
+    return;
 
-  char strCmd[256];
-  int cnt = 0;
-  while (cnt < count)
+  if (dma_reachable(src_addr, count) && dma_reachable(dest_addr, count) &&
+      !(dest_addr > src_addr && dest_addr < src_addr + count))
+    dma_run(DMA_CMD_COPY, src_addr, dest_addr, count);
+  else
+    host_copy(DMA_CMD_COPY, src_addr, dest_addr, count);
+}
+
+void cmdMFill(void)
+{
+  char* token = strtok(NULL, " ");
+
+  if (token == NULL)
   {
-    mem_data mem = get_mem(src_addr + cnt, true);
-    sprintf(strCmd, "s%X ", dest_addr + cnt);
-    for (int k = 0; k < 16; k++)
-    {
-      char strVal[10];
-      sprintf(strVal, "%02X ", mem.b[k]);
-      strcat(strCmd, strVal);
-      cnt++;
-      if (cnt >= count)
-        break;
-    }
-    printf("%d%%...\r", 100*cnt/count);
-    strcat(strCmd,"\n");
-    serialWrite(strCmd);
-    serialRead(inbuf, BUFSIZE);
+    printf("Invalid args\n");
+    return;
+  }
 
-    if (ctrlcflag)
-      break;
+  int addr = get_sym_value(token) & 0xfffffff;
+
+  token = strtok(NULL, " ");
+
+  if (token == NULL)
+  {
+    printf("Invalid args\n");
+    return;
   }
-  printf("\n");
+
+  int count = get_sym_value(token);
+
+  token = strtok(NULL, " ");
+
+  if (token == NULL)
+  {
+    printf("Invalid args\n");
+    return;
+  }
+
+  int val = get_sym_value(token) & 0xff;
+  if (count <= 0)
+    return;
+
+  if (dma_reachable(addr, count))
+    dma_run(DMA_CMD_FILL, val, addr, count);
+  else
+    host_copy(DMA_CMD_FILL, val, addr, count);
 }
 
 type_funcinfo* find_current_function(int pc)
@@ -4703,6 +6833,12 @@ void do_continue(int do_soft_break)
     serialWrite("t1\n");
     serialRead(inbuf, BUFSIZE);
   }
+  else if (!do_soft_break)
+  {
+    // parked on the breakpoint, so memory holds still again
+    cpu_running = false;
+    mem_epoch++;
+  }
 
   continue_mode = false;
   if (autocls)
@@ -4942,6 +7078,13 @@ int get_sym_value(char* token)
     token++;
   }
 
+  // (a worker loading a debug file can't read memory, or know the current file)
+  if (load_job != NULL && (deref_cnt != 0 || token[0] == ':'))
+  {
+    load_job->serial = true;
+    return 0;
+  }
+
   // if token starts with ":", then let's assume it is
   // for a line number of the current file
   if (token[0] == ':')
@@ -5561,23 +7704,11 @@ void stop_cpu_if_running(void)
 
 void set_mem(int addr, mem_data mem)
 {
-    char str[1024];
-    char extra[16];
-    // reset byte-values at this point
-
-    sprintf(str, "s777%04X ", addr);
-
-    for (int k = 0; k < 16; k++)
-    {
-      sprintf(extra, "%02X ", mem.b[k]);
-      strcat(str, extra);
-    }
+  unsigned char bytes[16];
 
-    strcat(str, "\n");
-    serialWrite(str);
-    usleep(10000);
-    serialRead(inbuf, BUFSIZE);
-    serialFlush();
+  for (int k = 0; k < 16; k++)
+    bytes[k] = mem.b[k];
+  poke_buffer_add(mem_cache_key(addr, false), bytes, 16);
 }
 
 void set_mem28array(int addr, mem_data* multimem)
@@ -5671,6 +7802,9 @@ void cmdRomW(void)
   }
 
   set_rom_writable(romw);
+  rom_epoch++;  // the rom pages cached before this follow the wrong epoch now
+  if (romw)
+    rom_image_dirty = true;
 }
 
 int find_hyppo_service_by_name(char *name)
@@ -6021,6 +8155,49 @@ void cmdWatchMDump(void)
   cmd_watch(TYPE_MDUMP);
 }
 
+// queue up the memory each watch is going to read, so that it can all be
+// fetched in one pipelined batch before the watches get printed
+void prefetch_watches(void)
+{
+  type_watch_entry* iter;
+
+  for (iter = lstWatches; iter != NULL; iter = iter->next)
+  {
+    bool useAddr28;
+
+    switch (iter->type)
+    {
+      case TYPE_DUMP:
+      case TYPE_MDUMP:
+        continue; // these already pipeline their own reads
+
+      case TYPE_MBYTE:
+      case TYPE_MWORD:
+      case TYPE_MDWORD:
+      case TYPE_MQWORD:
+      case TYPE_MSTRING:
+      case TYPE_MFLOAT:
+        useAddr28 = true;
+        break;
+
+      default:
+        useAddr28 = false;
+        break;
+    }
+
+    // leave source line lookups alone, as they report their own errors
+    if (iter->name[0] == ':')
+      continue;
+
+    int addr = get_sym_value(iter->name);
+    prefetch_add(addr, useAddr28);
+    if (iter->type == TYPE_STRING || iter->type == TYPE_MSTRING)
+      prefetch_add(addr + 16, useAddr28);
+  }
+
+  prefetch_run();
+}
+
 void cmdWatches(void)
 {
   type_watch_entry* iter = lstWatches;
@@ -6028,6 +8205,8 @@ void cmdWatches(void)
 
   printf("---------------------------------------\n");
 
+  prefetch_watches();
+
   while (iter != NULL)
   {
     cnt++;
@@ -6249,6 +8428,79 @@ void cmdFastMode(void)
 #endif
 }
 
+void cmdFastRead(void)
+{
+  char* token = strtok(NULL, " ");
+
+  // if no parameter, then just toggle it
+  if (token == NULL)
+    helper_reads = !helper_reads;
+  else if (strcmp(token, "1") == 0)
+    helper_reads = true;
+  else if (strcmp(token, "0") == 0)
+    helper_reads = false;
+
+  if (helper_reads && !helper_running)
+  {
+    load_helper();
+    serialFlush();
+  }
+
+  printf(" - fastread is turned %s.\n", helper_reads ? "on" : "off");
+}
+
+void cmdPageSums(void)
+{
+  char* token = strtok(NULL, " ");
+
+  // if no parameter, then just toggle it
+  if (token == NULL)
+    pagesums = !pagesums;
+  else if (strcmp(token, "1") == 0)
+    pagesums = true;
+  else if (strcmp(token, "0") == 0)
+    pagesums = false;
+
+  token = strtok(NULL, " ");
+  if (token != NULL)
+    pagesum_scratch = get_sym_value(token) & 0xff00;
+
+  printf(" - pagesums is turned %s (using $%04X-$%04X).\n", pagesums ? "on" : "off",
+    pagesum_scratch, pagesum_scratch + 0x100 + PAGESUM_MAX_PAGES*6 - 1);
+}
+
+void cmdMemCache(void)
+{
+  char* token = strtok(NULL, " ");
+
+  if (token != NULL)
+  {
+    int kb = 0;
+    sscanf(token, "%d", &kb);
+    if (kb < MEM_CACHE_MIN_KB)
+    {
+      printf("The memory cache needs at least %dKB\n", MEM_CACHE_MIN_KB);
+      return;
+    }
+    mem_cache_max_pages = kb * 4;
+    mem_cache_trim();
+  }
+
+  int current = 0, rom = 0;
+  for (mem_cache_page* pg = mem_cache_mru; pg != NULL; pg = pg->next)
+  {
+    if (!mem_cache_current(pg))
+      continue;
+    current++;
+    if (pg->rom)
+      rom++;
+  }
+
+  printf(" - memory cache: %dKB of %dKB in use (%d pages current, %d of them rom)\n",
+    mem_cache_pages / 4, mem_cache_max_pages / 4, current, rom);
+  printf(" - %d rows read from the cache, %d fetched\n", mem_cache_hits, mem_cache_misses);
+}
+
 void cmdScope(void)
 {
   char* token = strtok(NULL, " ");
@@ -6463,19 +8715,14 @@ int doOneShotAssembly(char* strCommand)
    return numbytes;
 }
 
-void find_addr_in_symmap(int addr, int eaddr)
-{
-  type_symmap_entry* iter = lstSymMap;
-
-  while (iter != NULL)
-  {
-    if ((eaddr == -1 && addr == iter->addr) ||
-        (addr <= iter->addr && iter->addr <= eaddr)) {
-      printf("%s : %s\n", iter->sval, iter->symbol);
-    }
+void find_addr_in_symmap(int addr, int eaddr)
+{
+  if (eaddr == -1)
+    eaddr = addr;
 
-    iter = iter->next;
-  }
+  type_symmap_entry* sme;
+  for (int k = symtab_lower_bound(&symMap, addr); (sme = symtab_at(&symMap, k)) != NULL && sme->addr <= eaddr; k++)
+    printf("%s : %s\n", sme->sval, sme->symbol);
 }
 
 void cmdSymbolValue(void)
@@ -6535,41 +8782,369 @@ void cmdSave(void)
 
   int cnt = 0;
   FILE* fsave = fopen(strBinFile, "wb");
+  static unsigned char buf[BULK_BATCH];
+  long long start = gettime_us();
   while (cnt < count)
   {
-    // get memory at current pc
-    mem_data* multimem = get_mem28array(addr + cnt);
+    int n = count - cnt;
+    if (n > BULK_BATCH)
+      n = BULK_BATCH;
 
-    for (int line = 0; line < 16; line++)
-    {
-      mem_data* mem = &multimem[line];
+    bulk_read(addr + cnt, buf, n);
+    if (ctrlcflag)
+      break;
 
-      for (int k = 0; k < 16; k++)
+    fwrite(buf, 1, n, fsave);
+    cnt += n;
+
+    printf("0x%X bytes saved...\r", cnt);
+    fflush(stdout);
+  }
+
+  long long elapsed = gettime_us() - start;
+  printf("\n0x%X bytes saved to \"%s\" (%.1f KB/s)\n", cnt, strBinFile,
+    elapsed > 0 ? cnt * 1000000.0 / 1024 / elapsed : 0.0);
+  fclose(fsave);
+}
+
+// ---------------------------------------------------------------------------
+// compressed loads
+//
+// 'load -z' compresses the file here, with a simple lz scheme (see unlz.a65
+// for the format), uploads the stream and has a small routine expand it on the
+// target. The stream goes at the end of the destination, far enough in that
+// the routine's output never catches up with what it's still to read, so it's
+// expanded in place. Whatever the stream overhangs past the end of the
+// destination is put back afterwards. The routine keeps a checksum of all it
+// writes, which is checked against the file's.
+
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 130
+#define LZ_MAX_LITERALS 128
+#define LZ_WINDOW 0xffff
+#define LZ_HASH_BITS 15
+#define LZ_CHAIN 32           // earlier positions tried for a match
+
+// the most a stream can grow to: a byte more for each token, and at worst
+// there is one for every match (of 3 bytes, at least) and one before it
+#define LZ_STREAM_MAX(count) ((count) + (count)/LZ_MIN_MATCH + 4)
+
+extern unsigned int unlzroutine_len;
+extern unsigned char unlzroutine[];
+extern int unlzroutine_relocs[];
+extern int unlzroutine_entry;
+extern int unlzroutine_idle;
+
+int lz_hash(unsigned char* p)
+{
+  return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << LZ_HASH_BITS) - 1);
+}
+
+// compresses 'count' bytes of 'in' into 'out', which needs room for
+// LZ_STREAM_MAX(count) bytes, and returns the stream's length
+int lz_compress(unsigned char* in, int count, unsigned char* out)
+{
+  int* head = (int*)malloc((1 << LZ_HASH_BITS) * sizeof(int));
+  int* prev = (int*)malloc((count + 1) * sizeof(int));
+  int len = 0;
+  int literals = 0;   // pending, from in[i - literals]
+
+  for (int k = 0; k < (1 << LZ_HASH_BITS); k++)
+    head[k] = -1;
+
+  for (int i = 0; i <= count; )
+  {
+    int best = 0;
+    int best_ofs = 0;
+
+    if (i + LZ_MIN_MATCH <= count)
+    {
+      int h = lz_hash(&in[i]);
+      int tries = LZ_CHAIN;
+      for (int j = head[h]; j >= 0 && i - j <= LZ_WINDOW && tries-- > 0; j = prev[j])
       {
-        fputc(mem->b[k], fsave);
+        int n = 0;
+        while (n < LZ_MAX_MATCH && i + n < count && in[j + n] == in[i + n])
+          n++;
+        if (n > best)
+        {
+          best = n;
+          best_ofs = i - j;
+        }
+      }
+    }
 
-        cnt++;
+    // flush the literals before a match, at the end, or once there's a run's worth
+    if (literals > 0 && (best >= LZ_MIN_MATCH || i == count || literals == LZ_MAX_LITERALS))
+    {
+      out[len++] = literals - 1;
+      memcpy(&out[len], &in[i - literals], literals);
+      len += literals;
+      literals = 0;
+    }
+    if (i == count)
+      break;
 
-        if (cnt >= count)
-          break;
+    int n = 1;
+    if (best >= LZ_MIN_MATCH)
+    {
+      out[len++] = 0x80 | (best - LZ_MIN_MATCH);
+      out[len++] = best_ofs & 0xff;
+      out[len++] = best_ofs >> 8;
+      n = best;
+    }
+    else
+      literals++;
+
+    for (int k = 0; k < n; k++, i++)
+    {
+      if (i + LZ_MIN_MATCH <= count)
+      {
+        int h = lz_hash(&in[i]);
+        prev[i] = head[h];
+        head[h] = i;
       }
+    }
+  }
+
+  // a match with an offset of 0 ends it
+  out[len++] = 0x80;
+  out[len++] = 0;
+  out[len++] = 0;
+
+  free(head);
+  free(prev);
+  return len;
+}
 
-      printf("0x%X bytes saved...\r", cnt);
-      if (cnt >= count)
+// how far from the start of the output the stream has to be put, so that
+// expanding it in place never writes over a byte of it that's still to be read
+int lz_in_place_offset(unsigned char* stream)
+{
+  int in = 0, out = 0;
+  int ofs = 0;
+
+  while (1)
+  {
+    int token = stream[in++];
+    int n;
+    if (token < 0x80)
+    {
+      n = token + 1;
+      in += n;
+    }
+    else
+    {
+      if (stream[in] == 0 && stream[in + 1] == 0)
         break;
+      n = (token & 0x7f) + LZ_MIN_MATCH;
+      in += 2;
     }
 
-    if (ctrlcflag)
-      break;
+    // the output only gains on the input over a match, and the last byte
+    // written is the closest it gets
+    out += n;
+    if (out - in > ofs)
+      ofs = out - in;
   }
+  return ofs;
+}
 
-  printf("\n0x%X bytes saved to \"%s\"\n", cnt, strBinFile);
-  fclose(fsave);
+// the same sums unlz.a65 keeps of what it writes
+void lz_sums(unsigned char* b, int count, unsigned char* sum)
+{
+  unsigned int s1 = 0, s2 = 0;
+
+  for (int k = 0; k < count; k++)
+  {
+    s1 += b[k];
+    s1 = (s1 & 0xff) + (s1 >> 8);
+    s2 += s1;
+    s2 = (s2 & 0xff) + (s2 >> 8);
+  }
+  sum[0] = s1;
+  sum[1] = s2;
+}
+
+// whether the routine can expand 'count' bytes at 'addr' (28-bit) itself
+bool lz_reachable(int addr, int count)
+{
+  if ((addr & 0xfff0000) == 0x7770000 || ((addr + count - 1) & 0xfff0000) == 0x7770000)
+    return false;
+  if (!mem_range_cacheable(addr, count))
+    return false;
+  if (!romw && addr < ROM_START + ROM_SIZE && addr + count > ROM_START)
+    return false;
+  for (int page = addr & ~0xff; page < addr + count; page += 256)
+    if (pagesum_scratch_page(page))
+      return false;
+  return true;
+}
+
+// compresses the 'count' bytes of 'data' into 'stream', uploads it and has it
+// expanded to 'addr' (28-bit). Returns false (having said why) if it couldn't.
+bool lz_load(unsigned char* data, int count, unsigned char* stream, int addr, char* strBinFile)
+{
+  static unsigned char image[256];
+  unsigned char sum[2];
+  long long start = gettime_us();
+
+  int len = lz_compress(data, count, stream);
+  int ofs = lz_in_place_offset(stream);
+  int over = ofs + len > count ? ofs + len - count : 0;
+
+  if (len >= count)
+  {
+    printf("load -z: '%s' doesn't compress\n", strBinFile);
+    return false;
+  }
+  if (!lz_reachable(addr, count + over))
+  {
+    printf("load -z: the routine can't reach all of $%07X-$%07X\n", addr, addr + count + over - 1);
+    return false;
+  }
+
+  unsigned char* overhang = (unsigned char*)malloc(over + 1);
+  if (over > 0)
+    bulk_read(addr + count, overhang, over);
+
+  long long upload = gettime_us();
+  put_mem28(addr + ofs, stream, len);
+  upload = gettime_us() - upload;
+
+  memset(image, 0, sizeof(image));
+  memcpy(&image[unlzroutine_entry], unlzroutine, unlzroutine_len);
+  for (int k = 0; unlzroutine_relocs[k] >= 0; k++)
+    image[unlzroutine_entry + unlzroutine_relocs[k]] = pagesum_scratch >> 8;
+  for (int k = 0; k < 4; k++)
+  {
+    image[0 + k] = (addr + ofs) >> (k*8);
+    image[4 + k] = addr >> (k*8);
+  }
+
+  // a poll per page out is plenty, even for a slow cpu
+  bool expanded = scratch_run("load -z", image, sizeof(image), unlzroutine_entry, unlzroutine_idle,
+    PAGESUM_POLLS + count / 256);
+
+  if (over > 0)
+    put_mem28(addr + count, overhang, over);
+  free(overhang);
+  if (addr < ROM_START + ROM_SIZE && addr + count > ROM_START)
+    rom_epoch++;
+  if (!expanded)
+    return false;
+
+  lz_sums(data, count, sum);
+  if (image[0x0c] != sum[0] || image[0x0d] != sum[1])
+  {
+    printf("load -z: the checksum didn't match (expected $%02X%02X, got $%02X%02X)\n",
+      sum[0], sum[1], image[0x0c], image[0x0d]);
+    return false;
+  }
+
+  long long elapsed = gettime_us() - start;
+  printf("0x%X bytes loaded from \"%s\" as 0x%X compressed (%d%%), checksum ok\n",
+    count, strBinFile, len, (int)(100LL * len / count));
+  printf("%.1f KB/s effective, against %.1f KB/s for the raw upload\n",
+    elapsed > 0 ? count * 1000000.0 / 1024 / elapsed : 0.0,
+    upload > 0 ? len * 1000000.0 / 1024 / upload : 0.0);
+  return true;
+}
+
+// loads 'count' bytes from 'fload' to 'addr' (28-bit) as a compressed stream.
+// Returns false (having said why) if it couldn't, so it can be loaded as it is
+// instead.
+bool load_compressed(FILE* fload, int addr, int count, char* strBinFile)
+{
+  if (cpu_running || helper_running)
+  {
+    printf("load -z: the routine needs the cpu, which is running\n");
+    return false;
+  }
+
+  unsigned char* data = (unsigned char*)malloc(count);
+  unsigned char* stream = (unsigned char*)malloc(LZ_STREAM_MAX(count));
+  bool success = false;
+
+  if (fread(data, 1, count, fload) == count)
+    success = lz_load(data, count, stream, addr, strBinFile);
+  else
+    printf("Error reading the file '%s'!\n", strBinFile);
+
+  free(data);
+  free(stream);
+  return success;
+}
+
+// uploads the pages of 'count' bytes at 'key' from 'buf' that differ from what
+// the target already has there, going by the page checksum routine (see
+// pagesum_target()), and returns how many bytes that was. Part pages, and any
+// that the routine's scratch area could be in, are always sent.
+int load_delta(int key, unsigned char* buf, int count)
+{
+  int page_addrs[PAGESUM_MAX_PAGES];
+  unsigned char sums[PAGESUM_MAX_PAGES*3];
+  int idx[PAGESUM_MAX_PAGES];
+  bool same[PAGESUM_MAX_PAGES] = { false };
+  int pages = (key & 0xff) == 0 ? count / 256 : 0;
+  int n = 0;
+  int sent = 0;
+
+  for (int k = 0; k < pages && k < PAGESUM_MAX_PAGES; k++)
+  {
+    if (pagesum_scratch_page(key + k*256))
+      continue;
+    page_addrs[n] = key + k*256;
+    idx[n++] = k;
+  }
+
+  if (n > 0 && pagesum_target(page_addrs, n, sums))
+  {
+    for (int k = 0; k < n; k++)
+    {
+      unsigned char sum[3];
+      pagesum_calc(&buf[idx[k]*256], sum);
+      same[idx[k]] = memcmp(sum, &sums[k*3], 3) == 0;
+    }
+  }
+
+  // send the rest, a run of pages at a time
+  for (int ofs = 0; ofs < count; )
+  {
+    if (ofs / 256 < pages && same[ofs / 256])
+    {
+      ofs += 256;
+      continue;
+    }
+
+    int end = ofs;
+    while (end < count && !(end / 256 < pages && same[end / 256]))
+      end += 256;
+    if (end > count)
+      end = count;
+
+    put_mem28(key + ofs, &buf[ofs], end - ofs);
+    sent += end - ofs;
+    ofs = end;
+  }
+
+  return sent;
 }
 
 void cmdLoad(void)
 {
   char* strBinFile = strtok(NULL, " ");
+  bool delta = false;
+  bool compress = false;
+
+  while (strBinFile && (strcmp(strBinFile, "--delta") == 0 || strcmp(strBinFile, "-z") == 0))
+  {
+    if (strcmp(strBinFile, "--delta") == 0)
+      delta = true;
+    else
+      compress = true;
+    strBinFile = strtok(NULL, " ");
+  }
 
   if (!strBinFile)
   {
@@ -6601,40 +9176,311 @@ void cmdLoad(void)
 
   FILE* fload = fopen(strBinFile, "rb");
 
-  if(fload)
+  if (!fload)
+  {
+    printf("Error opening the file '%s'!\n", strBinFile);
+    return;
+  }
+
+  fseek(fload, 0, SEEK_END);
+  int fsize = ftell(fload);
+  if (count == -1 || count > fsize - offs)
+    count = fsize - offs;
+  fseek(fload, offs, SEEK_SET);
+  addr &= 0xfffffff;
+
+  if (compress && count > 0)
   {
-    fseek(fload, 0, SEEK_END);
-    int fsize = ftell(fload);
-    rewind(fload);
-    if (offs != 0)
-      fseek(fload, offs, SEEK_SET);
-    if (count != -1)
-      fsize = count;
-    char* buffer = (char *)malloc(fsize*sizeof(char));
-    if(buffer)
+    if (load_compressed(fload, addr, count, strBinFile))
     {
-      fread(buffer, fsize, 1, fload);
+      fclose(fload);
+      return;
+    }
+    printf("Loading '%s' as it is instead\n", strBinFile);
+    fseek(fload, offs, SEEK_SET);
+  }
 
-      int i = 0;
-      while(i < fsize)
-      {
-        int outSize = fsize - i;
-        if(outSize > 16) {
-          outSize = 16;
-        }
+  // the checksum routine needs the cpu, and is no use on the i/o area
+  if (delta && (cpu_running || helper_running || !mem_range_cacheable(addr, count)))
+  {
+    printf("Can't load --delta %s, so loading all of it\n",
+      mem_range_cacheable(addr, count) ? "while the cpu is running" : "into the i/o area");
+    delta = false;
+  }
 
-        put_mem28array(addr + i, (unsigned char*) (buffer + i), outSize);
-        i += outSize;
-      }
+  // streamed from the file straight into binary 'l' uploads (see put_mem28()),
+  // a batch at a time. With --delta, a batch is as many pages as the checksum
+  // routine does at once, and only starts part way into a page at the start.
+  int cnt = 0;
+  int sent = 0;
+  int batch = delta ? PAGESUM_MAX_PAGES*256 : BULK_BATCH;
+  static unsigned char buf[PAGESUM_MAX_PAGES*256 > BULK_BATCH ? PAGESUM_MAX_PAGES*256 : BULK_BATCH];
+  long long start = gettime_us();
+  while (cnt < count)
+  {
+    int key = addr + cnt;
+    int n = count - cnt;
+    if (n > batch)
+      n = batch;
+    if (delta && (key & 0xff) != 0 && n > 0x100 - (key & 0xff))
+      n = 0x100 - (key & 0xff);
+
+    n = fread(buf, 1, n, fload);
+    if (n <= 0)
+      break;
+
+    // the i/o area gets 's' commands, rather than a dma
+    if (delta)
+      sent += load_delta(key, buf, n);
+    else if (mem_range_cacheable(key, n))
+      put_mem28(key, buf, n);
+    else
+      put_mem28array(key, buf, n);
+    cnt += n;
 
-      free(buffer);
+    printf("0x%X bytes loaded...\r", cnt);
+    fflush(stdout);
+
+    if (ctrlcflag)
+      break;
+  }
+  poke_buffer_flush();
+
+  long long elapsed = gettime_us() - start;
+  printf("\n0x%X bytes loaded from \"%s\" (%.1f KB/s)\n", cnt, strBinFile,
+    elapsed > 0 ? cnt * 1000000.0 / 1024 / elapsed : 0.0);
+  if (delta)
+    printf("0x%X bytes sent, 0x%X skipped as unchanged\n", sent, cnt - sent);
+  fclose(fload);
+}
+
+// ---------------------------------------------------------------------------
+// watching the build
+//
+// 'watchbuild' loads a binary, then waits on inotify for the assembler/linker
+// to write it (or any of the list and map files) again. The binary is compared
+// with what was last pushed, and only the runs of bytes that differ are sent.
+// A changed list or label file has just what was loaded from it dropped and
+// loaded afresh, as does one whose .map file changed.
+
+#define WATCH_SETTLE_MS 200   // quiet time after the last write, before acting on them
+#define WATCH_GAP 16          // differing runs closer than this are sent as one
+#define WATCH_CHANGES_MAX 32
+
+// pushes the bytes of 'fname' that differ from 'image' ('size' bytes of what
+// was last pushed to 'addr'), and swaps 'image' for the file's bytes.
+// Returns the number of bytes sent, or -1 if the file couldn't be read.
+int watch_push(const char* fname, int addr, unsigned char** image, int* size)
+{
+  FILE* f = fopen(fname, "rb");
+  if (f == NULL)
+    return -1;
+
+  fseek(f, 0, SEEK_END);
+  int fsize = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char* buf = (unsigned char*)malloc(fsize + 1);
+  fsize = fread(buf, 1, fsize, f);
+  fclose(f);
+
+  int sent = 0;
+  int k = 0;
+  while (k < fsize)
+  {
+    if (k < *size && buf[k] == (*image)[k])
+    {
+      k++;
+      continue;
     }
-      fclose(fload);
+
+    // the run goes on until WATCH_GAP bytes in a row are the same again
+    int end = k + 1;
+    for (int same = 0; end < fsize && same < WATCH_GAP; end++)
+      same = (end < *size && buf[end] == (*image)[end]) ? same + 1 : 0;
+    while (end > k + 1 && end <= *size && buf[end - 1] == (*image)[end - 1])
+      end--;
+
+    // the i/o area gets 's' commands, rather than a dma
+    if (mem_range_cacheable(addr + k, end - k))
+      put_mem28(addr + k, &buf[k], end - k);
+    else
+      put_mem28array(addr + k, &buf[k], end - k);
+    sent += end - k;
+    k = end;
+  }
+  poke_buffer_flush();
+
+  free(*image);
+  *image = buf;
+  *size = fsize;
+  return sent;
+}
+
+// re-indexes whatever was loaded from, or along with, the debug file 'fname'
+void watch_reload(char* fname)
+{
+  char* ext = get_extension(fname);
+  bool calypsi_map_loaded = false;
+
+  // the calypsi map is shared by all its lists, so start again
+  if (ext != NULL && strcmp(ext, ".clst") == 0)
+  {
+    printf("'%s' changed, reloading all the list and map files\n", fname);
+    cmdReload();
+    return;
+  }
+
+  // a .map is loaded along with the list of the same name
+  int len = ext != NULL ? ext - fname : strlen(fname);
+  for (int k = 0; k < debug_files_cnt; k++)
+  {
+    char* origin = debug_files[k];
+    char* oext = get_extension(origin);
+    if (origin == fname || strcmp(origin, fname) == 0 ||
+        (oext != NULL && oext - origin == len && strncmp(origin, fname, len) == 0))
+    {
+      printf("'%s' changed, re-indexing \"%s\"\n", fname, origin);
+      unload_debug_file(origin);
+      if (access(origin, R_OK) == 0)
+        load_debug_file(origin, &calypsi_map_loaded);
+    }
+  }
+
+  // a new one?
+  for (int k = 0; k < debug_files_cnt; k++)
+    if (strcmp(debug_files[k], fname) == 0)
+      return;
+  load_debug_file(fname, &calypsi_map_loaded);
+}
+
+void cmdWatchBuild(void)
+{
+#ifndef __linux__
+  printf("watchbuild needs inotify, so only works on linux\n");
+#else
+  char* strBinFile = strtok(NULL, " ");
+  if (!strBinFile)
+  {
+    printf("Missing <binfile> parameter!\n");
+    return;
+  }
+
+  char* strAddr = strtok(NULL, " ");
+  if (!strAddr)
+  {
+    printf("Missing <addr> parameter!\n");
+    return;
+  }
+
+  int addr = get_sym_value(strAddr) & 0xfffffff;
+  char* strRestart = strtok(NULL, " ");
+  int restart = strRestart ? get_sym_value(strRestart) : -1;
+
+  // the binary may well be built somewhere other than where the list files are
+  char bindir[1024];
+  char* binname = strrchr(strBinFile, '/');
+  if (binname != NULL)
+  {
+    snprintf(bindir, sizeof(bindir), "%.*s", (int)(binname - strBinFile), strBinFile);
+    binname++;
   }
   else
   {
+    strcpy(bindir, ".");
+    binname = strBinFile;
+  }
+
+  int fd = inotify_init1(IN_NONBLOCK);
+  int wd = fd < 0 ? -1 : inotify_add_watch(fd, ".", IN_CLOSE_WRITE | IN_MOVED_TO);
+  int bin_wd = wd < 0 ? -1 : inotify_add_watch(fd, bindir, IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (bin_wd < 0)
+  {
+    printf("Couldn't watch for the build (%s)\n", strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+
+  unsigned char* image = NULL;
+  int size = 0;
+  int sent = watch_push(strBinFile, addr, &image, &size);
+  if (sent < 0)
     printf("Error opening the file '%s'!\n", strBinFile);
+  else
+    printf("0x%X bytes loaded from \"%s\"\n", sent, strBinFile);
+  printf("Watching for \"%s\" and the list and map files to be rebuilt (ctrl-c to stop)...\n", strBinFile);
+
+  char changes[WATCH_CHANGES_MAX][256];
+  int changes_cnt = 0;
+  bool bin_changed = false;
+
+  while (!ctrlcflag)
+  {
+    // gather up the writes until they've settled
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    bool pending = bin_changed || changes_cnt > 0;
+    if (poll(&pfd, 1, pending ? WATCH_SETTLE_MS : 500) > 0)
+    {
+      char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+      int len;
+      while ((len = read(fd, events, sizeof(events))) > 0)
+      {
+        for (char* p = events; p < events + len; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len)
+        {
+          struct inotify_event* ev = (struct inotify_event*)p;
+          if (ev->len == 0)
+            continue;
+          if (ev->wd == bin_wd && strcmp(ev->name, binname) == 0)
+            bin_changed = true;
+
+          char* ext = get_extension(ev->name);
+          if (ev->wd != wd || ext == NULL || strlen(ev->name) >= sizeof(changes[0]) ||
+              (strcmp(ext, ".map") != 0 && strcmp(ext, ".lbl") != 0 && strcmp(ext, ".klist") != 0 &&
+               strcmp(ext, ".clst") != 0 && strcmp(ext, ".lst") != 0 && strcmp(ext, ".list") != 0 &&
+               strcmp(ext, ".rep") != 0))
+            continue;
+
+          int k;
+          for (k = 0; k < changes_cnt; k++)
+            if (strcmp(changes[k], ev->name) == 0)
+              break;
+          if (k == changes_cnt && changes_cnt < WATCH_CHANGES_MAX)
+            strcpy(changes[changes_cnt++], ev->name);
+        }
+      }
+      continue;
+    }
+    if (!pending)
+      continue;
+
+    for (int k = 0; k < changes_cnt; k++)
+      watch_reload(changes[k]);
+    changes_cnt = 0;
+
+    if (bin_changed)
+    {
+      sent = watch_push(strBinFile, addr, &image, &size);
+      if (sent < 0)
+        printf("Error opening the file '%s'!\n", strBinFile);
+      else
+        printf("\"%s\" rebuilt: 0x%X bytes sent, 0x%X unchanged\n", strBinFile, sent, size - sent);
+
+      if (sent >= 0 && restart >= 0)
+      {
+        char command_str[64];
+        sprintf(command_str, "g %04X\n", restart);
+        serialWrite(command_str);
+        serialRead(inbuf, BUFSIZE);
+        printf("Restarted at $%04X\n", restart);
+      }
+    }
+    bin_changed = false;
+    fflush(stdout);
   }
+
+  free(image);
+  close(fd);
+#endif
 }
 
 void cmdBackTrace(void)
@@ -6693,6 +9539,9 @@ void cmdDownFrame(void)
   cmdDisassemble();
 }
 
+// how many 256-byte blocks search_range() reads in one go
+#define SEARCH_BATCH 64
+
 void search_range(int addr, int total, unsigned char *bytes, int length)
 {
   int cnt = 0;
@@ -6708,23 +9557,28 @@ void search_range(int addr, int total, unsigned char *bytes, int length)
   }
   printf("\n");
 
+  static unsigned char buf[SEARCH_BATCH*256];
+
   while (cnt < total)
   {
-    // get memory at current pc
-    mem_data *multimem = get_mem28array(addr + cnt);
+    // fetch the next few 256-byte blocks in one go
+    int blocks = (total - cnt + 255) / 256;
+    if (blocks > SEARCH_BATCH)
+      blocks = SEARCH_BATCH;
+    bulk_read(addr + cnt, buf, blocks*256);
 
-    for (int m = 0; m < 16; m++)
+    for (int m = 0; m < blocks*16; m++)
     {
-      mem_data mem = multimem[m];
+      unsigned char* b = &buf[m*16];
 
       for (int k = 0; k < 16; k++)
       {
         if (!found_start)
         {
-          if (mem.b[k] == bytes[0])
+          if (b[k] == bytes[0])
           {
             found_start = true;
-            start_loc = mem.addr + k;
+            start_loc = addr + cnt + k;
             found_count++;
             if (length == 1) {
               printf("%07X\n", start_loc);
@@ -6737,7 +9591,7 @@ void search_range(int addr, int total, unsigned char *bytes, int length)
         }
         else // matched till the end?
         {
-          if (mem.b[k] == bytes[found_count])
+          if (b[k] == bytes[found_count])
           {
             found_count++;
             // we found a complete match?
@@ -6821,23 +9675,16 @@ void cmdSearch(void)
   }
 }
 
-extern int fd;
-
 void cmdScreenshot(void)
 {
-  int orig_fcntl = fcntl(fd, F_GETFL, NULL);
-  fcntl(fd,F_SETFL,orig_fcntl|O_NONBLOCK);
   get_video_state();
   do_screen_shot_ascii();
-  fcntl(fd,F_SETFL,orig_fcntl);
 }
 
 extern int type_text_cr;
 void cmdType(void)
 {
   char* tok = strtok(NULL, "\0");
-  int orig_fcntl = fcntl(fd, F_GETFL, NULL);
-  fcntl(fd,F_SETFL,orig_fcntl|O_NONBLOCK);
 
   if (tok != NULL)
   {
@@ -6848,21 +9695,18 @@ void cmdType(void)
   {
     do_type_text("-");
   }
-  fcntl(fd,F_SETFL,orig_fcntl);
 }
 
 extern char pathBitstream[];
 int do_ftp(char* bitstream);
-extern char devSerial[];
 
 void cmdFtp(void)
 {
-  int orig_fcntl = fcntl(fd, F_GETFL, NULL);
-  fcntl(fd,F_SETFL,orig_fcntl|O_NONBLOCK);
   do_ftp(pathBitstream);
-  fcntl(fd,F_SETFL,orig_fcntl);
-  serialClose();
-  serialOpen(devSerial);
+
+  // ftp shares our connection, so there's no need to re-open it, just to
+  // drop whatever the reset left behind
+  serialFlush();
 }
 
 int cmdGetCmdCount(void)
@@ -1,6 +1,8 @@
 /* vim: set expandtab shiftwidth=2 tabstop=2: */
 
 #include <stdbool.h>
+#include "symtab.h"
+#include "fileloc.h"
 
 void listSearch(void);
 void cmdRawHelp(void);
@@ -70,12 +72,16 @@ void cmdType(void);
 void cmdFtp(void);
 void cmdPetscii(void);
 void cmdFastMode(void);
+void cmdFastRead(void);
+void cmdMemCache(void);
+void cmdPageSums(void);
 void cmdScope(void);
 void cmdOffs(void);
 void cmdPrintValue(void);
 void cmdForwardDis(void);
 void cmdBackwardDis(void);
 void cmdMCopy(void);
+void cmdMFill(void);
 void cmdLocals(void);
 void cmdAutoLocals(void);
 void cmdMapping(void);
@@ -88,17 +94,20 @@ void cmdGo(void);
 void cmdPalette(void);
 void cmdHyppo(void);
 void cmdReload(void);
+void cmdWatchBuild(void);
 void cmdRomW(void);
 int doOneShotAssembly(char* strCommand);
 int  cmdGetCmdCount(void);
 char* cmdGetCmdName(int idx);
 int isValidMnemonic(char* str);
+void poke_buffer_flush(void);
 
 #define BUFSIZE 65536
 
 extern char outbuf[];
 extern char inbuf[];
 extern bool ctrlcflag;
+extern bool load_verbose;
 
 // Define a struct to hold bitfield details
 typedef struct {
@@ -148,14 +157,6 @@ typedef struct
   char* help;
 } type_command_details;
 
-typedef struct tse
-{
-  char* symbol;
-  int addr;   // integer value of symbol
-  char* sval; // string value of symbol
-  struct tse* next;
-} type_symmap_entry;
-
 typedef struct tseg
 {
   char name[64];
@@ -187,5 +188,5 @@ typedef struct we
 } type_watch_entry;
 
 extern type_command_details command_details[];
-extern type_symmap_entry* lstSymMap;
+extern type_symtab symMap;
 extern type_watch_entry* lstWatches;
@@ -0,0 +1,309 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * fileloc.c - the mapping between addresses and source lines, loaded from the
+ * list files.
+ *
+ * Every disassembly and step looks up the line for the PC, and big .list
+ * files have tens of thousands of lines, so rather than a list kept in order
+ * as it's loaded (a walk for every line added, and for every lookup):
+ *
+ * - the entries are appended to an array as they're loaded (with a hash of
+ *   their addresses, as a line loaded for an address that's already there
+ *   replaces the file and line number of the one before)
+ * - the first lookup after a load sorts them by address, and works out the
+ *   furthest any range (addr..lastaddr) reaches up to each entry, so finding
+ *   the entry for an address is a binary search for each
+ * - it also indexes them by file and line, for the lookups the other way
+ *
+ * An address inside an earlier entry's range gets that entry, even if there's
+ * one for the address itself, as it did when the list was walked in order.
+ *
+ * Entries dropped by fileloc_remove_origin() stay allocated (so pointers held
+ * to them don't dangle) until fileloc_clear().
+ */
+
+#define _BSD_SOURCE _BSD_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "fileloc.h"
+
+#define FILELOC_CHUNK 4096
+
+struct tflc
+{
+  struct tflc* next;
+  int used;
+  type_fileloc entries[FILELOC_CHUNK];
+};
+
+// FNV-1a
+static unsigned int hash_line(const char* file, int lineno)
+{
+  unsigned int h = 2166136261u;
+  while (*file)
+    h = (h ^ (unsigned char)*file++) * 16777619u;
+  return h ^ (lineno * 2654435761u);
+}
+
+static unsigned int hash_addr(int addr)
+{
+  return addr * 2654435761u;
+}
+
+static void addr_rebuild(type_filelocs* fls, int bucket_cnt)
+{
+  free(fls->addr_buckets);
+  fls->addr_bucket_cnt = bucket_cnt;
+  fls->addr_buckets = calloc(bucket_cnt, sizeof(type_fileloc*));
+  for (int k = 0; k < fls->count; k++)
+  {
+    type_fileloc* e = fls->by_addr[k];
+    unsigned int b = hash_addr(e->addr) & (bucket_cnt - 1);
+    e->addr_next = fls->addr_buckets[b];
+    fls->addr_buckets[b] = e;
+  }
+}
+
+// the one copy of each file's name
+static char* intern_file(type_filelocs* fls, const char* file)
+{
+  for (int k = fls->file_cnt - 1; k >= 0; k--)
+    if (strcmp(fls->files[k], file) == 0)
+      return fls->files[k];
+
+  fls->files = realloc(fls->files, (fls->file_cnt + 1) * sizeof(char*));
+  fls->files[fls->file_cnt] = strdup(file);
+  return fls->files[fls->file_cnt++];
+}
+
+static int cmp_addr(const void* a, const void* b)
+{
+  const type_fileloc* ea = *(const type_fileloc**)a;
+  const type_fileloc* eb = *(const type_fileloc**)b;
+
+  return ea->addr < eb->addr ? -1 : ea->addr > eb->addr;
+}
+
+static void build_index(type_filelocs* fls)
+{
+  if (fls->indexed)
+    return;
+  fls->indexed = true;
+
+  qsort(fls->by_addr, fls->count, sizeof(type_fileloc*), cmp_addr);
+
+  fls->reach = realloc(fls->reach, (fls->count + 1) * sizeof(int));
+  int reach = -1;
+  for (int k = 0; k < fls->count; k++)
+  {
+    type_fileloc* e = fls->by_addr[k];
+    if (e->lastaddr != 0 && e->lastaddr > reach)
+      reach = e->lastaddr;
+    fls->reach[k] = reach;
+  }
+
+  // added from the top down, so the first of a line in each bucket is the
+  // one at the lowest address
+  free(fls->line_buckets);
+  fls->line_bucket_cnt = fls->addr_bucket_cnt;
+  fls->line_buckets = calloc(fls->line_bucket_cnt, sizeof(type_fileloc*));
+  for (int k = fls->count - 1; k >= 0; k--)
+  {
+    type_fileloc* e = fls->by_addr[k];
+    unsigned int b = hash_line(e->file, e->lineno) & (fls->line_bucket_cnt - 1);
+    e->line_next = fls->line_buckets[b];
+    fls->line_buckets[b] = e;
+  }
+}
+
+/**
+ * adds the line 'fl' (its file name is copied), or if there's one for its
+ * address already, gives that its file and line number instead.
+ * returns the entry.
+ */
+type_fileloc* fileloc_add(type_filelocs* fls, type_fileloc* fl)
+{
+  type_fileloc* e = NULL;
+
+  if (fls->addr_bucket_cnt > 0)
+  {
+    e = fls->addr_buckets[hash_addr(fl->addr) & (fls->addr_bucket_cnt - 1)];
+    while (e != NULL && e->addr != fl->addr)
+      e = e->addr_next;
+  }
+
+  fls->indexed = false;
+  fls->version++;
+
+  // replace existing?
+  if (e != NULL)
+  {
+    e->file = intern_file(fls, fl->file);
+    e->lineno = fl->lineno;
+    e->origin = fl->origin;
+    return e;
+  }
+
+  if (fls->arena == NULL || fls->arena->used == FILELOC_CHUNK)
+  {
+    type_fileloc_chunk* c = malloc(sizeof(type_fileloc_chunk));
+    c->next = fls->arena;
+    c->used = 0;
+    fls->arena = c;
+  }
+  e = &fls->arena->entries[fls->arena->used++];
+  *e = *fl;
+  e->file = intern_file(fls, fl->file);
+
+  if (fls->count == fls->size)
+  {
+    fls->size = fls->size ? fls->size * 2 : 1024;
+    fls->by_addr = realloc(fls->by_addr, fls->size * sizeof(type_fileloc*));
+  }
+  fls->by_addr[fls->count++] = e;
+
+  if (fls->count > fls->addr_bucket_cnt)
+    addr_rebuild(fls, fls->addr_bucket_cnt ? fls->addr_bucket_cnt * 2 : 1024);
+  else
+  {
+    unsigned int b = hash_addr(e->addr) & (fls->addr_bucket_cnt - 1);
+    e->addr_next = fls->addr_buckets[b];
+    fls->addr_buckets[b] = e;
+  }
+
+  return e;
+}
+
+// the entry for the line at 'addr' (or whose range covers it), or NULL
+type_fileloc* fileloc_find(type_filelocs* fls, int addr)
+{
+  build_index(fls);
+
+  // the first entry at or after 'addr'
+  int lo = 0, hi = fls->count;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (fls->by_addr[mid]->addr < addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  int at = lo;
+
+  // and the first before that reaching as far as 'addr'
+  lo = 0;
+  hi = at;
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (fls->reach[mid] < addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < at)
+    return fls->by_addr[lo];
+
+  if (at < fls->count && fls->by_addr[at]->addr == addr)
+    return fls->by_addr[at];
+
+  return NULL;
+}
+
+// the entry (at the lowest address) for 'lineno' of 'file', or NULL
+type_fileloc* fileloc_find_line(type_filelocs* fls, const char* file, int lineno)
+{
+  build_index(fls);
+
+  if (fls->line_bucket_cnt == 0)
+    return NULL;
+
+  type_fileloc* e = fls->line_buckets[hash_line(file, lineno) & (fls->line_bucket_cnt - 1)];
+  while (e != NULL && (e->lineno != lineno || strcmp(e->file, file) != 0))
+    e = e->line_next;
+
+  return e;
+}
+
+void fileloc_remove_origin(type_filelocs* fls, const char* origin)
+{
+  int n = 0;
+
+  for (int k = 0; k < fls->count; k++)
+    if (fls->by_addr[k]->origin != origin)
+      fls->by_addr[n++] = fls->by_addr[k];
+
+  if (n == fls->count)
+    return;
+  fls->count = n;
+  fls->indexed = false;
+  fls->version++;
+  addr_rebuild(fls, fls->addr_bucket_cnt);
+}
+
+/**
+ * fills 'addrs' with the address of each of lines 1..'line_cnt' of 'file' (at
+ * [lineno-1]), as fileloc_find_line() would give them, or -1 for a line with
+ * no code
+ */
+void fileloc_line_addrs(type_filelocs* fls, const char* file, int* addrs, int line_cnt)
+{
+  const char* name = NULL;
+
+  for (int k = 0; k < line_cnt; k++)
+    addrs[k] = -1;
+
+  for (int k = 0; k < fls->file_cnt && name == NULL; k++)
+    if (strcmp(fls->files[k], file) == 0)
+      name = fls->files[k];
+  if (name == NULL)
+    return;
+
+  // (from the lowest address up, so the first of each line is the one kept)
+  build_index(fls);
+  for (int k = 0; k < fls->count; k++)
+  {
+    type_fileloc* e = fls->by_addr[k];
+    if (e->file == name && e->lineno >= 1 && e->lineno <= line_cnt && addrs[e->lineno - 1] == -1)
+      addrs[e->lineno - 1] = e->addr;
+  }
+}
+
+/**
+ * adds all of 'from' to 'fls', as if they'd been added to it directly. A
+ * range given to one of them after it was added (as the acme loader does) is
+ * given to the entry it lands on, whether that's a new one or not.
+ */
+void fileloc_merge(type_filelocs* fls, type_filelocs* from)
+{
+  for (int k = 0; k < from->count; k++)
+  {
+    type_fileloc* e = fileloc_add(fls, from->by_addr[k]);
+    if (from->by_addr[k]->lastaddr != 0)
+      e->lastaddr = from->by_addr[k]->lastaddr;
+  }
+}
+
+void fileloc_clear(type_filelocs* fls)
+{
+  while (fls->arena != NULL)
+  {
+    type_fileloc_chunk* c = fls->arena;
+    fls->arena = c->next;
+    free(c);
+  }
+
+  for (int k = 0; k < fls->file_cnt; k++)
+    free(fls->files[k]);
+  free(fls->files);
+  free(fls->by_addr);
+  free(fls->reach);
+  free(fls->addr_buckets);
+  free(fls->line_buckets);
+
+  unsigned int version = fls->version;
+  memset(fls, 0, sizeof(type_filelocs));
+  fls->version = version + 1;
+}
@@ -0,0 +1,55 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * fileloc.h - the mapping between addresses and source lines, loaded from the
+ * list files.
+ */
+
+#ifndef FILELOC_H
+#define FILELOC_H
+
+#include <stdbool.h>
+
+typedef struct tfl
+{
+  int addr;
+  int lastaddr;
+  char* file;
+  char* module;
+  int lineno;
+  const char* origin; // the debug file it was loaded from
+  struct tfl* addr_next;
+  struct tfl* line_next;
+} type_fileloc;
+
+typedef struct tflc type_fileloc_chunk;
+
+typedef struct
+{
+  type_fileloc** by_addr;   // by address, once indexed
+  int* reach;               // the furthest lastaddr of any entry up to each one
+  int count;
+  int size;
+  bool indexed;
+
+  type_fileloc** addr_buckets;  // by address, kept as they're added
+  int addr_bucket_cnt;
+  type_fileloc** line_buckets;  // by file and line, once indexed
+  int line_bucket_cnt;
+
+  char** files;
+  int file_cnt;
+  type_fileloc_chunk* arena;
+
+  unsigned int version;     // bumped by every change (clears too)
+} type_filelocs;
+
+type_fileloc* fileloc_add(type_filelocs* fls, type_fileloc* fl);
+type_fileloc* fileloc_find(type_filelocs* fls, int addr);
+type_fileloc* fileloc_find_line(type_filelocs* fls, const char* file, int lineno);
+void fileloc_remove_origin(type_filelocs* fls, const char* origin);
+void fileloc_line_addrs(type_filelocs* fls, const char* file, int* addrs, int line_cnt);
+void fileloc_merge(type_filelocs* fls, type_filelocs* from);
+void fileloc_clear(type_filelocs* fls);
+
+#endif // FILELOC_H
@@ -49,11 +49,16 @@
 #include <pthread.h>
 #include "m65.h"
 #include "screen_shot.h"
+#include "transport.h"
+#include "monparse.h"
 
 #define SLOW_FACTOR 1
 #define SLOW_FACTOR2 1
 #define DEBUG 0 // change to 1 later to debug
 
+// a key has to stay down (and up) for a whole frame for the KERNAL to see it
+#define KEY_HOLD_USEC 20000
+
 #ifdef WINDOWS
 #include <windows.h>
 #undef SLOW_FACTOR
@@ -120,8 +125,6 @@ int halt=0;
 
 int usedk=0;
 
-extern bool unix_socket_flag;
-
 // 0 = old hard coded monitor, 1= Kenneth's 65C02 based fancy monitor
 // Only REALLY old bitstreams don't have the new monitor
 int new_monitor=1;
@@ -271,10 +274,17 @@ void timestamp_msg(char *msg)
 }
 
 
+// borrow this from commands.c
+void poke_buffer_flush(void);
+
 int slow_write(PORT_TYPE fd,char *d,int l)
 {
-  // UART is at 2Mbps, but we need to allow enough time for a whole line of
-  // writing. 100 chars x 0.5usec = 500usec. So 1ms between chars should be ok.
+  // writes the debugger still has buffered have to reach the target first
+  poke_buffer_flush();
+
+  // Each command (up to and including its CR) goes out in one write, and we
+  // then wait for the monitor to echo it back before sending the next, rather
+  // than trickling it out a character at a time with a sleep between each.
   int i;
 #if DEBUG
   printf("\nWriting ");
@@ -287,19 +297,16 @@ int slow_write(PORT_TYPE fd,char *d,int l)
   //fgets(line,1024,stdin);
 #endif
 
+  int start=0;
   for(i=0;i<l;i++)
   {
-    if (serial_speed==4000000) do_usleep(1000*SLOW_FACTOR); else do_usleep(2000*SLOW_FACTOR);
-    int w=serialport_write(fd,(unsigned char *)&d[i],1);
-    while (w<1) {
-      if (serial_speed==4000000) do_usleep(500*SLOW_FACTOR); else do_usleep(1000*SLOW_FACTOR);
-      w=serialport_write(fd,(unsigned char *)&d[i],1);
+    if (d[i]=='\r'||d[i]=='\n'||i==l-1) {
+      serialNoteCommand(&d[start],i+1-start);
+      if (transport_write_command(monitor_link,&d[start],i+1-start)<0) return -1;
+      start=i+1;
     }
   }
 
-  if (unix_socket_flag)
-    do_usleep(30000*SLOW_FACTOR); 
-
   return 0;
 }
 
@@ -371,7 +378,6 @@ int stop_cpu(void)
   }
   // Stop CPU
   printf("Stopping CPU\n");
-  do_usleep(50000);
   slow_write(fd,"t1\r",3);
   cpu_stopped=1;
   return 0;
@@ -384,7 +390,6 @@ int start_cpu(void)
     timestamp_msg("");
     fprintf(stderr,"Starting CPU\n");
   }
-  do_usleep(50000);
   slow_write(fd,"t0\r",3);
   cpu_stopped=0;
   return 0;
@@ -400,7 +405,6 @@ int load_file(char *filename,int load_addr,int patchHyppo)
     exit(-2);
   }
 
-  do_usleep(50000);
   unsigned char buf[65536];
   int max_bytes;
   int byte_limit=4096;
@@ -455,20 +459,8 @@ int load_file(char *filename,int load_addr,int patchHyppo)
       sprintf(cmd,"l%x %x\r",munged_load_addr-1,(munged_load_addr+b-1)&0xffff);
     // printf("  command ='%s'\n",cmd);
     slow_write(fd,cmd,strlen(cmd));
-    do_usleep(5000*SLOW_FACTOR);
-    int n=b;
-    unsigned char *p=buf;
-    while(n>0) {
-      int w=serialport_write(fd,p,n);
-      if (w>0) { p+=w; n-=w; } else do_usleep(1000*SLOW_FACTOR);
-    }
-    if (serial_speed==230400) do_usleep(10000+50*b*SLOW_FACTOR);
-    else if (serial_speed==2000000)
-      // 2mbit/sec / 11bits/char (inc space) = ~5.5usec per char
-      do_usleep(6*b*SLOW_FACTOR2);
-    else
-      // 4mbit/sec / 11bits/char (inc space) = ~2.6usec per char
-      do_usleep(3*b*SLOW_FACTOR2);
+    // the monitor gives its prompt once it has all of the data
+    transport_write_payload(monitor_link,buf,b);
 #endif
 
     load_addr+=b;
@@ -652,17 +644,9 @@ int virtual_f011_read(int device,int track,int sector,int side)
           sprintf(cmd,"l%x %x\r",READ_SECTOR_BUFFER_ADDRESS-1,
               READ_SECTOR_BUFFER_ADDRESS+0x200-1);
         slow_write(fd,cmd,strlen(cmd));
-        do_usleep(1000*SLOW_FACTOR);
-        int n=0x200;
-        unsigned char *p=buf;
         //        fprintf(stderr,"%s\n",cmd);
-        //        dump_bytes(0,"F011 virtual sector data",p,512);
-        while(n>0) {
-          int w=serialport_write(fd,p,n);
-          if (w>0) { p+=w; n-=w; } else do_usleep(1000*SLOW_FACTOR);
-        }
-        if (serial_speed==230400) do_usleep(10000+50*b*SLOW_FACTOR);
-        else do_usleep(10000+6*b*SLOW_FACTOR);
+        //        dump_bytes(0,"F011 virtual sector data",buf,512);
+        transport_write_payload(monitor_link,buf,0x200);
 #ifdef WINDOWS       
         printf("T+%I64d ms : Block sent.\n",gettime_ms()-start);
 #else 
@@ -761,24 +745,18 @@ int monitor_sync(void)
      Send #<token> until we see the token returned to us.
      */
 
-  unsigned char read_buff[8192];
-
   // Begin by sending a null command and purging input
   char cmd[8192];
   cmd[0]=0x15; // ^U
   cmd[1]='#'; // prevent instruction stepping
   cmd[2]=0x0d; // Carriage return
-  do_usleep(20000); // Give plenty of time for things to settle
   slow_write_safe(fd,cmd,3);
   //  printf("Wrote empty command.\n");
-  do_usleep(20000); // Give plenty of time for things to settle
-  int b=1;
-  // Purge input  
+  // Purge input, until the monitor has gone quiet
   //  printf("Purging input.\n");
-  while(b>0) {
-    b=serialport_read(fd,read_buff,8192);
-    //    if (b>0) dump_bytes(2,"Purged input",read_buff,b);
-  }
+  transport_flush(monitor_link);
+  while(transport_fill(monitor_link,5)>0)
+    transport_flush(monitor_link);
 
   for(int tries=0;tries<10;tries++) {
 #ifdef WINDOWS
@@ -787,24 +765,24 @@ int monitor_sync(void)
     snprintf(cmd,1024,"#%08lx\r",random());
 #endif
     //    printf("Writing token: '%s'\n",cmd);
+    // slow_write() paces on the echo, so once it returns the token is
+    // usually already in the buffer
     slow_write_safe(fd,cmd,strlen(cmd));
-
-    for(int i=0;i<10;i++) {
-      do_usleep(10000*SLOW_FACTOR);      
-      b=serialport_read(fd,read_buff,8192);
-      if (b<0) b=0;
-      if (b>8191) b=8191;
-      read_buff[b]=0;
-      //      if (b>0) dump_bytes(2,"Sync input",read_buff,b);
-
-      //      if (b>0) dump_bytes(0,"read_data",read_buff,b);
-      if (strstr((char *)read_buff,cmd)) {
-        //  printf("Found token. Synchronised with monitor.\n");
-        state=99;
-        return 0;      
+    cmd[9]=0;
+
+    long long deadline=transport_time_ms()+100*SLOW_FACTOR;
+    do {
+      const uint8_t *data;
+      int b=transport_peek(monitor_link,&data);
+      for(int i=0;i+9<=b;i++) {
+        if (!memcmp(&data[i],cmd,9)) {
+          //  printf("Found token. Synchronised with monitor.\n");
+          transport_consume(monitor_link,i+9);
+          state=99;
+          return 0;
+        }
       }
-    }
-    do_usleep(10000*SLOW_FACTOR);
+    } while(transport_fill(monitor_link,(int)(deadline-transport_time_ms()))>0);
   }
   printf("Failed to synchronise with the monitor.\n");
   return 1;
@@ -907,35 +885,24 @@ int breakpoint_wait(void)
 int push_ram(unsigned long address,unsigned int count,unsigned char *buffer)
 {
   char cmd[8192];
+  monitor_sync();
   for(unsigned int offset=0;offset<count;)
   {
     int b=count-offset;      
     // Limit to same 64KB slab
-    if (b>(0xffff-((address+offset)&0xffff)))
-      b=(0xffff-((address+offset)&0xffff));
+    if (b>(0x10000-((address+offset)&0xffff)))
+      b=(0x10000-((address+offset)&0xffff));
     if (b>4096) b=4096;
 
-    monitor_sync();
-
     if (new_monitor) 
       sprintf(cmd,"l%lx %lx\r",address+offset,(address+offset+b)&0xffff);
     else
       sprintf(cmd,"l%lx %lx\r",address+offset-1,address+offset+b-1);
     slow_write(fd,cmd,strlen(cmd));
-    do_usleep(1000*SLOW_FACTOR);
-    int n=b;
-    unsigned char *p=&buffer[offset];
-    while(n>0) {
-      int w=serialport_write(fd,p,n);
-      if (w>0) { p+=w; n-=w; } else do_usleep(1000*SLOW_FACTOR);
-    }
-    if (serial_speed==230400) do_usleep(10000+50*b*SLOW_FACTOR);
-    else if (serial_speed==2000000)
-      // 2mbit/sec / 11bits/char (inc space) = ~5.5usec per char
-      do_usleep(6*b*SLOW_FACTOR2);
-    else
-      // 4mbit/sec / 11bits/char (inc space) = ~2.6usec per char
-      do_usleep(3*b*SLOW_FACTOR2);
+    // Each block is only done once the monitor prompts again, so we don't
+    // need to sync up again before the next one
+    if (transport_write_payload(monitor_link,&buffer[offset],b)<0)
+      return -1;
 
     offset+=b;
   }
@@ -951,12 +918,13 @@ int fetch_ram(unsigned long address,unsigned int count,unsigned char *buffer)
   unsigned long addr=address;
   unsigned long end_addr;
   char cmd[8192];
-  unsigned char read_buff[8192];
-  char next_addr_str[8192];
-  int ofs=0;
 
   //  fprintf(stderr,"Fetching $%x bytes @ $%x\n",count,address);
 
+  // Bigger reads go via the helper when it's in use, as it sends binary
+  if (helper_reads&&count>=256&&!helper_read_mem(address,count,buffer))
+    return 0;
+
 #ifdef __CYGWIN__
   monitor_sync();
 #endif
@@ -971,41 +939,34 @@ int fetch_ram(unsigned long address,unsigned int count,unsigned char *buffer)
     //printf("Sending '%s'\n",cmd);
     slow_write_safe(fd,cmd,strlen(cmd));
     while(addr!=end_addr) {
-      snprintf(next_addr_str,8192,"\n:%08X:",(unsigned int)addr);
-      int b=serialport_read(fd,&read_buff[ofs],8192-ofs);
-      if (b<0) b=0;
-      if ((ofs+b)>8191) b=8191-ofs;
-      //      if (b) dump_bytes(0,"read data",&read_buff[ofs],b);
-      read_buff[ofs+b]=0;
-      ofs+=b;
-      char *s=strstr((char *)read_buff,next_addr_str);
-      if (s&&(strlen(s)>=42)) {
-        char b=s[42]; s[42]=0;
-        if (0) {
-          printf("Found data for $%08x:\n%s\n",
-              (unsigned int)addr,
-              s);
-        } 
-        s[42]=b;
-        for(int i=0;i<16;i++) {
-
-          // Don't write more bytes than requested
-          if ((addr-address+i)>=count) break;
-
-          char hex[3];
-          hex[0]=s[1+10+i*2+0];
-          hex[1]=s[1+10+i*2+1];
-          hex[2]=0;
-          buffer[addr-address+i]=strtol(hex,NULL,16);
+      // Decode lines as they arrive, straight out of the transport's buffer,
+      // and let go of everything up to the last one we've dealt with
+      const uint8_t *data;
+      int len=transport_peek(monitor_link,&data);
+      int used=0;
+      for(int i=0;i+1+MEM_LINE_LEN<=len&&addr!=end_addr;i++) {
+        if (data[i]!='\n'||data[i+1]!=':') continue;
+        uint32_t line_addr;
+        uint8_t bytes[16];
+        if (monparse_mem_line((const char *)&data[i+1],len-i-1,&line_addr,bytes)<0) continue;
+        if (line_addr==addr) {
+          for(int k=0;k<16;k++) {
+            // Don't write more bytes than requested
+            if ((addr-address+k)>=count) break;
+            buffer[addr-address+k]=bytes[k];
+          }
+          addr+=16;
         }
-        addr+=16;
-
-        // Shuffle buffer down
-        int s_offset=(long)s-(long)read_buff+42;
-        bcopy(&read_buff[s_offset],&read_buff[0],8192-(ofs-s_offset));
-        ofs-=s_offset;
+        i+=MEM_LINE_LEN;
+        used=i+1;
       }
+      // anything short of a whole line from the end can't start a line we want
+      if (addr!=end_addr&&len-MEM_LINE_LEN>used) used=len-MEM_LINE_LEN;
+      transport_consume(monitor_link,used);
+
+      if (addr!=end_addr&&transport_fill(monitor_link,monitor_link->timeout_ms)<=0) break;
     }
+    if (addr!=end_addr) break;
   }
   if (addr>=(address+count)) {
     //    fprintf(stderr,"Memory read complete at $%lx\n",addr);
@@ -1018,45 +979,25 @@ int fetch_ram(unsigned long address,unsigned int count,unsigned char *buffer)
   }
 }
 
-unsigned char ram_cache[512*1024+255];
-unsigned char ram_cache_valids[512*1024+255];
-int ram_cache_initialised=0;
+// borrow these from commands.c
+bool mem_range_cacheable(int key,int count);
+void mem_cache_read(int key,unsigned char *buf,int count);
 
 int fetch_ram_invalidate(void)
 {
-  ram_cache_initialised=0;
+  mem_epoch++;
   return 0;
 }
 
 int fetch_ram_cacheable(unsigned long address,unsigned int count,unsigned char *buffer)
 {
-  if (!ram_cache_initialised) {
-    ram_cache_initialised=1;
-    bzero(ram_cache_valids,512*1024);
-    bzero(ram_cache,512*1024);
-  }
-  if ((address+count)>=(512*1024)) {
+  // Shares the debugger's memory cache (see commands.c), which stays valid
+  // until the CPU runs or memory gets written (or for ROM, until it's reloaded),
+  // fetches whole pages at a time for bigger reads, and leaves the I/O area alone
+  if (!mem_range_cacheable(address,count))
     return fetch_ram(address,count,buffer);
-  }
-
-  // See if we need to fetch it fresh
-  for(int i=0;i<count;i++) {
-    if (!ram_cache_valids[address+i]) {
-      // Cache not valid here -- so read some data
-      printf("."); fflush(stdout);
-      //      printf("Fetching $%08x for cache.\n",address);
-      fetch_ram(address,256,&ram_cache[address]);
-      for(int j=0;j<256;j++) ram_cache_valids[address+j]=1;
-
-      bcopy(&ram_cache[address],buffer,count);
-      return 0;
-    }
-  }
-
-  // It's valid in the cache
-  bcopy(&ram_cache[address],buffer,count);
+  mem_cache_read(address,buffer,count);
   return 0;
-
 }
 
 
@@ -1237,8 +1178,12 @@ void do_type_key(unsigned char key)
   //  fprintf(stderr,"keys $%02x $%02x\n",c1,c2);
   snprintf(cmd,1024,"sffd3615 %02x %02x\n",c1,c2);
   slow_write(fd,cmd,strlen(cmd));
+  // Now that the writes don't dawdle, make sure the KERNAL's keyboard scan
+  // gets to see both the key going down, and coming back up again
+  do_usleep(KEY_HOLD_USEC);
   // Stop pressing keys
   slow_write(fd,"sffd3615 7f 7f 7f \n",19);
+  do_usleep(KEY_HOLD_USEC);
 
 }
 
@@ -1264,6 +1209,7 @@ void do_type_text(char *type_text)
 
         // carriage return at end of line
         slow_write(fd,"sffd3615 01 7f 7f \n",19);
+        do_usleep(KEY_HOLD_USEC);
         slow_write(fd,"sffd3615 7f 7f 7f \n",19);
 
         line[0]=0; fgets(line,1024,stdin);
@@ -1443,8 +1389,10 @@ void do_type_text(char *type_text)
   }
 
   // RETURN at end if requested
-  if (type_text_cr)
+  if (type_text_cr) {
     slow_write(fd,"sffd3615 01 7f 7f \n",19);
+    do_usleep(KEY_HOLD_USEC);
+  }
 }
 // Stop pressing keys
 slow_write(fd,"sffd3615 7f 7f 7f \n",19);
@@ -1595,26 +1543,19 @@ SSIZE_T serialport_read(HANDLE port, uint8_t * buffer, size_t size)
 }
 
 #else
+// these go through the shared transport (see transport.c), so that we see the
+// same buffered data as the debugger commands. The fd is only kept for the
+// sake of the callers.
 int serialport_write(int fd, uint8_t * buffer, size_t size)
 {
-#ifdef __APPLE__
-  return write(fd,buffer,size);
-#else
-  size_t offset=0;
-  while(offset<size) {
-    int written=write(fd,&buffer[offset],size-offset);
-    if (written>0) offset+=written;
-    if (offset<size) { usleep(1000);
-      //      printf("Wrote %d bytes\n",written);
-    }
-  }
-#endif
-  return size;
+  return transport_write(monitor_link,buffer,size);
 }
 
+// Returns whatever is buffered or arrives within a millisecond, so callers
+// polling in a loop don't spin.
 size_t serialport_read(int fd, uint8_t * buffer, size_t size)
 {
-  return read(fd,buffer,size);
+  return transport_read(monitor_link,buffer,size,1);
 }
 
 void set_serial_speed(int fd,int serial_speed)
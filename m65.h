@@ -25,5 +25,10 @@ int start_cpu(void);
 void timestamp_msg(char *msg);
 int detect_mode(void);
 void do_type_text(char *type_text);
+int load_helper(void);
+int helper_read_mem(uint32_t address,uint32_t len,uint8_t *buffer);
+
+extern int helper_running;
+extern int helper_reads;
 
 #endif // M65_H
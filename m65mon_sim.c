@@ -0,0 +1,992 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * m65mon_sim.c - a stand-in for a mega65's serial monitor, so m65dbg can be
+ * load-tested (and its ftp job queue exercised) without hardware.
+ *
+ * Build with 'make m65mon-sim', then start it and point m65dbg at its socket:
+ *
+ *   ./m65mon-sim [-s <socket>] [-b <bps> | -d <nsec>] [-g <pc>] [-S <sdcard.img>]
+ *                [<addr28>:<file> | <file.prg>] ...
+ *   ./m65dbg -l unix#<socket>
+ *
+ *   -s  the unix-domain socket to listen on (default "m65mon.sock")
+ *   -b  simulate a link running at <bps> (eg, 2000000 or 4000000), 10 bits/byte
+ *   -d  or give the link's per-byte delay directly, in nsec (default 0 = none)
+ *   -g  the cpu's initial PC (default $0801)
+ *   -S  an sd-card image for the ftp helper's sector jobs (default all zeroes,
+ *       with writes dropped)
+ *
+ * Memory is a sparse 28-bit image, filled from the files given: "<addr>:<file>"
+ * loads a raw file at a 28-bit (hex) address, and a plain "<file>" loads a .prg
+ * at the address in its first two bytes. Anything not loaded reads as zero,
+ * apart from a few registers set up so m65dbg sees a machine in C64 mode.
+ *
+ * It understands the commands m65dbg sends: r, m/M, s/S, l (with the binary
+ * upload after it), t0/t1, a blank line or t (step), N (step over), b, g, z,
+ * ! (reset), + (bitrate, ignored), # (sync) and ?, echoing each command and
+ * ending its output with the "\n." prompt, as the monitor does.
+ *
+ * No code is run. A step moves the PC over one instruction, following jmp, jsr
+ * and rts, and resuming (t0) with a breakpoint set stops at the breakpoint, as
+ * if the program had run into it.
+ *
+ * Once the ftp helper has been uploaded and started (g080d), a write to $C000
+ * runs the queued jobs natively, replying in the helper's format: sector reads
+ * and writes (jobs $01/$02) against the sd-card image, and memory reads (job
+ * $11) sent back rle packed.
+ *
+ * Likewise, resuming (t0) at the entry of m65dbg's page checksum routine (see
+ * pagesum.a65) works out its checksums natively, and leaves the PC in its idle
+ * loop, as does resuming at the entry of its lz decompressor (see unlz.a65)
+ * with the stream it's pointed at. Resuming at one of m65dbg's temporary routines (a few loads and stores
+ * ending in a jmp to itself) runs it, along with any enhanced dma job list it
+ * triggers with a store to $D705, so mcopy and mfill work.
+ */
+
+#define _BSD_SOURCE _BSD_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "gs4510.h"
+
+// ---------------------------------------------------------------------------
+// sparse 28-bit memory
+
+#define PAGE_BITS 12
+#define PAGE_SIZE (1 << PAGE_BITS)
+#define NUM_PAGES (1 << (28 - PAGE_BITS))
+
+static uint8_t* pages[NUM_PAGES];
+
+static uint8_t mem_peek(uint32_t addr)
+{
+  uint8_t* page = pages[(addr & 0xfffffff) >> PAGE_BITS];
+  return page ? page[addr & (PAGE_SIZE - 1)] : 0;
+}
+
+static void mem_poke(uint32_t addr, uint8_t val)
+{
+  uint8_t** page = &pages[(addr & 0xfffffff) >> PAGE_BITS];
+  if (*page == NULL)
+    *page = (uint8_t*)calloc(1, PAGE_SIZE);
+  (*page)[addr & (PAGE_SIZE - 1)] = val;
+}
+
+// $777xxxx is the cpu's view of memory: bank 0, with the io at $D000
+static uint32_t phys_addr(uint32_t addr)
+{
+  addr &= 0xfffffff;
+  if ((addr >> 16) != 0x777)
+    return addr;
+  addr &= 0xffff;
+  if ((addr & 0xf000) == 0xd000)
+    return 0xffd3000 | (addr & 0xfff);
+  return addr;
+}
+
+static uint32_t cpu_addr(uint16_t addr)
+{
+  return phys_addr(0x7770000 | addr);
+}
+
+static bool load_image(const char* arg)
+{
+  const char* path = arg;
+  const char* colon = strchr(arg, ':');
+  uint32_t addr = 0;
+  bool prg = true;
+
+  if (colon)
+  {
+    addr = strtoul(arg, NULL, 16);
+    path = colon + 1;
+    prg = false;
+  }
+
+  FILE* f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    printf("Could not open '%s'\n", path);
+    return false;
+  }
+
+  if (prg)
+  {
+    int lo = fgetc(f);
+    int hi = fgetc(f);
+    addr = lo | (hi << 8);
+  }
+
+  int c, len = 0;
+  while ((c = fgetc(f)) != EOF)
+    mem_poke(addr + len++, c);
+  fclose(f);
+
+  printf("Loaded '%s' at $%07X-$%07X\n", path, addr, addr + len - 1);
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// the link
+
+static int client = -1;
+static long long byte_ns = 0;     // simulated time per byte on the wire
+static long long rx_free_ns;      // when each direction of the link is next free
+static long long tx_free_ns;
+
+#define OUT_SIZE (256 * 1024)
+static char out[OUT_SIZE];
+static int out_len;
+
+static struct
+{
+  int commands;
+  long long bytes_in;
+  long long bytes_out;
+} stats;
+
+static long long now_ns(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return ((long long)tv.tv_sec * 1000000 + tv.tv_usec) * 1000;
+}
+
+// holds off until 'n' more bytes could have crossed the simulated link
+static void link_pace(long long* free_ns, int n)
+{
+  if (byte_ns == 0)
+    return;
+
+  long long now = now_ns();
+  if (*free_ns < now)
+    *free_ns = now;
+  *free_ns += n * byte_ns;
+  if (*free_ns - now >= 1000)
+    usleep((*free_ns - now) / 1000);
+}
+
+static void out_flush(void)
+{
+  // send in small pieces, so the output trickles in as it would over a uart
+  for (int ofs = 0; ofs < out_len; )
+  {
+    int n = out_len - ofs;
+    if (n > 256)
+      n = 256;
+    link_pace(&tx_free_ns, n);
+    n = send(client, &out[ofs], n, 0);
+    if (n <= 0)
+      break;
+    ofs += n;
+  }
+  stats.bytes_out += out_len;
+  out_len = 0;
+}
+
+static void out_bytes(const void* data, int len)
+{
+  if (out_len + len > OUT_SIZE)
+    out_flush();
+  memcpy(&out[out_len], data, len);
+  out_len += len;
+}
+
+static void out_printf(const char* fmt, ...)
+{
+  char str[256];
+  va_list ap;
+
+  va_start(ap, fmt);
+  int n = vsnprintf(str, sizeof(str), fmt, ap);
+  va_end(ap);
+  if (n >= (int)sizeof(str))
+    n = sizeof(str) - 1;
+  if (n > 0)
+    out_bytes(str, n);
+}
+
+// ---------------------------------------------------------------------------
+// the cpu (or as much of it as the monitor shows)
+
+#define HISTORY_LEN 2400    // m65dbg's 'z' reads this many lines of pc history
+#define HELPER_ENTRY 0x080d
+
+static struct
+{
+  uint16_t pc;
+  uint8_t a, x, y, z, b;
+  uint16_t sp;
+  uint16_t maph, mapl;
+  uint8_t lastop;
+  uint8_t p;
+} cpu;
+
+static uint16_t reset_pc = 0x0801;
+static bool tracing = true;         // t1: the cpu is stopped, and steps on request
+static int breakpoint = -1;
+static bool helper_running = false;
+
+static uint16_t history[HISTORY_LEN];
+static int history_pos;
+
+static void cpu_reset(void)
+{
+  memset(&cpu, 0, sizeof(cpu));
+  cpu.pc = reset_pc;
+  cpu.sp = 0x01f9;
+  cpu.p = 0x22;
+  tracing = true;
+  breakpoint = -1;
+  helper_running = false;
+}
+
+static uint16_t cpu_peek16(uint16_t addr)
+{
+  return mem_peek(cpu_addr(addr)) | (mem_peek(cpu_addr(addr + 1)) << 8);
+}
+
+static void cpu_push(uint8_t val)
+{
+  mem_poke(cpu_addr(cpu.sp), val);
+  cpu.sp--;
+}
+
+static uint8_t cpu_pull(void)
+{
+  cpu.sp++;
+  return mem_peek(cpu_addr(cpu.sp));
+}
+
+static void cpu_step(bool over)
+{
+  uint8_t op = mem_peek(cpu_addr(cpu.pc));
+  uint16_t next = cpu.pc + 1 + opcode_mode[mode_lut[op]].val;
+
+  switch (op)
+  {
+    case 0x20:  // jsr $nnnn
+      if (!over)
+      {
+        cpu_push((next - 1) >> 8);
+        cpu_push(next - 1);
+        next = cpu_peek16(cpu.pc + 1);
+      }
+      break;
+
+    case 0x4c:  // jmp $nnnn
+      next = cpu_peek16(cpu.pc + 1);
+      break;
+
+    case 0x60:  // rts
+      next = cpu_pull();
+      next |= cpu_pull() << 8;
+      next++;
+      break;
+  }
+
+  history[history_pos] = cpu.pc;
+  history_pos = (history_pos + 1) % HISTORY_LEN;
+  cpu.lastop = op;
+  cpu.pc = next;
+}
+
+static void show_regs(void)
+{
+  static const char flag_names[] = "NVEBDIZC";
+  char flags[9];
+
+  for (int k = 0; k < 8; k++)
+    flags[k] = (cpu.p & (0x80 >> k)) ? flag_names[k] : '.';
+  flags[8] = '\0';
+
+  out_printf("\r\nPC   A  X  Y  Z  B  SP   MAPH MAPL LAST-OP     P  P-FLAGS   RGP uS IO");
+  out_printf("\r\n%04X %02X %02X %02X %02X %02X %04X %04X %04X %02X %02X %02X %s",
+    cpu.pc, cpu.a, cpu.x, cpu.y, cpu.z, cpu.b, cpu.sp, cpu.maph, cpu.mapl,
+    cpu.lastop, cpu.p, 0, flags);
+}
+
+// ---------------------------------------------------------------------------
+// the ftp helper's jobs
+
+static FILE* sdcard = NULL;
+
+static void sd_read_sector(uint32_t sector, uint8_t* buf)
+{
+  memset(buf, 0, 512);
+  if (sdcard && fseek(sdcard, (long)sector * 512, SEEK_SET) == 0)
+    fread(buf, 1, 512, sdcard);
+}
+
+static void sd_write_sector(uint32_t sector, const uint8_t* buf)
+{
+  if (sdcard && fseek(sdcard, (long)sector * 512, SEEK_SET) == 0)
+    fwrite(buf, 1, 512, sdcard);
+}
+
+// packs 'len' bytes the way the helper does: $80|n = n copies of the next
+// byte, n = n raw bytes follow (n up to 127)
+static void out_rle(uint32_t addr, uint32_t len)
+{
+  uint8_t raw[127];
+  int raw_len = 0;
+
+  for (uint32_t k = 0; k < len; )
+  {
+    uint8_t v = mem_peek(phys_addr(addr + k));
+    uint32_t run = 1;
+    while (run < 127 && k + run < len && mem_peek(phys_addr(addr + k + run)) == v)
+      run++;
+
+    if (run >= 3 || raw_len == sizeof(raw))
+    {
+      if (raw_len)
+      {
+        uint8_t n = raw_len;
+        out_bytes(&n, 1);
+        out_bytes(raw, raw_len);
+        raw_len = 0;
+      }
+    }
+    if (run >= 3)
+    {
+      uint8_t hdr[2] = { 0x80 | run, v };
+      out_bytes(hdr, 2);
+      k += run;
+    }
+    else
+    {
+      raw[raw_len++] = v;
+      k++;
+    }
+  }
+
+  if (raw_len)
+  {
+    uint8_t n = raw_len;
+    out_bytes(&n, 1);
+    out_bytes(raw, raw_len);
+  }
+}
+
+static void run_jobs(int count)
+{
+  uint32_t job = 0xc001;
+  uint8_t sector[512];
+
+  for (int n = 0; n < count; n++, job += 9)
+  {
+    uint8_t op = mem_peek(job);
+    uint32_t addr = mem_peek(job + 1) | (mem_peek(job + 2) << 8) |
+      (mem_peek(job + 3) << 16) | ((uint32_t)mem_peek(job + 4) << 24);
+    uint32_t arg = mem_peek(job + 5) | (mem_peek(job + 6) << 8) |
+      (mem_peek(job + 7) << 16) | ((uint32_t)mem_peek(job + 8) << 24);
+
+    switch (op)
+    {
+      case 0x01:  // read sector 'arg' to 'addr'
+        sd_read_sector(arg, sector);
+        for (int k = 0; k < 512; k++)
+          mem_poke(addr + k, sector[k]);
+        break;
+
+      case 0x02:  // write sector 'arg' from 'addr'
+        for (int k = 0; k < 512; k++)
+          sector[k] = mem_peek(addr + k);
+        sd_write_sector(arg, sector);
+        break;
+
+      case 0x11:  // send 'arg' bytes from 'addr'
+        out_printf("FTJOBDATA:%x:%x:", addr, arg);
+        out_rle(addr, arg);
+        break;
+
+      default:
+        printf("Unknown helper job $%02X\n", op);
+        break;
+    }
+    out_printf("\r\nFTJOBDONE:%d\r\n", n);
+  }
+
+  out_printf("FTBATCHDONE\r\n");
+  mem_poke(0xc000, 0);
+}
+
+// ---------------------------------------------------------------------------
+// m65dbg's page checksum routine
+
+extern unsigned int pagesumroutine_len;
+extern unsigned char pagesumroutine[];
+extern int pagesumroutine_relocs[];
+extern int pagesumroutine_entry;
+extern int pagesumroutine_idle;
+
+// whether the pc is at the entry of one of m65dbg's routines, moved to the
+// pc's page (see pagesum.c and unlz.c)
+static bool routine_at_pc(unsigned char* code, unsigned int len, int* relocs, int entry)
+{
+  uint16_t page = cpu.pc & 0xff00;
+  int reloc = 0;
+
+  if ((cpu.pc & 0xff) != entry)
+    return false;
+  for (int k = 0; k < (int)len; k++)
+  {
+    uint8_t expected = code[k];
+    if (k == relocs[reloc])
+    {
+      expected = page >> 8;
+      reloc++;
+    }
+    if (mem_peek(cpu_addr(cpu.pc + k)) != expected)
+      return false;
+  }
+  return true;
+}
+
+// if the pc is at the routine's entry, runs it and returns true
+static bool run_pagesum(void)
+{
+  uint16_t page = cpu.pc & 0xff00;
+
+  if (!routine_at_pc(pagesumroutine, pagesumroutine_len, pagesumroutine_relocs, pagesumroutine_entry))
+    return false;
+
+  int count = mem_peek(cpu_addr(page + 7));
+  uint16_t list = cpu_peek16(page + 8);
+  uint16_t results = cpu_peek16(page + 10);
+
+  for (int n = 0; n < count; n++, list += 3, results += 3)
+  {
+    uint8_t b0 = mem_peek(cpu_addr(list));
+    uint8_t b1 = mem_peek(cpu_addr(list + 1));
+    uint8_t b2 = mem_peek(cpu_addr(list + 2));
+    unsigned int s1 = 0, s2 = 0, s3 = 0;
+
+    for (int k = 0; k < 256; k++)
+    {
+      uint8_t v = b2 == 0xff ? mem_peek(cpu_addr((b0 << 8) + k)) :
+        mem_peek(((uint32_t)b2 << 24 | b1 << 16 | b0 << 8) + k);
+      s1 += v;
+      s1 = (s1 & 0xff) + (s1 >> 8);
+      s2 += s1;
+      s2 = (s2 & 0xff) + (s2 >> 8);
+      s3 += s2;
+      s3 = (s3 & 0xff) + (s3 >> 8);
+    }
+    mem_poke(cpu_addr(results), s1);
+    mem_poke(cpu_addr(results + 1), s2);
+    mem_poke(cpu_addr(results + 2), s3);
+  }
+
+  mem_poke(cpu_addr(page + 7), 0);
+  cpu.pc = page + pagesumroutine_idle;
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// m65dbg's lz decompressor ('load -z')
+
+extern unsigned int unlzroutine_len;
+extern unsigned char unlzroutine[];
+extern int unlzroutine_relocs[];
+extern int unlzroutine_entry;
+extern int unlzroutine_idle;
+
+static uint32_t cpu_peek32(uint16_t addr)
+{
+  return cpu_peek16(addr) | ((uint32_t)cpu_peek16(addr + 2) << 16);
+}
+
+// if the pc is at the routine's entry, runs it and returns true
+static bool run_unlz(void)
+{
+  uint16_t page = cpu.pc & 0xff00;
+
+  if (!routine_at_pc(unlzroutine, unlzroutine_len, unlzroutine_relocs, unlzroutine_entry))
+    return false;
+
+  uint32_t src = cpu_peek32(page + 0);
+  uint32_t dst = cpu_peek32(page + 4);
+  unsigned int s1 = mem_peek(cpu_addr(page + 12));
+  unsigned int s2 = mem_peek(cpu_addr(page + 13));
+
+  for (;;)
+  {
+    uint8_t token = mem_peek(src++);
+    uint32_t from = 0;
+    int n;
+
+    if (token < 0x80)
+    {
+      n = token + 1;
+      from = src;
+      src += n;
+    }
+    else
+    {
+      int ofs = mem_peek(src) | (mem_peek(src + 1) << 8);
+      src += 2;
+      if (ofs == 0)
+        break;
+      n = (token & 0x7f) + 3;
+      from = dst - ofs;
+    }
+
+    for (int k = 0; k < n; k++)
+    {
+      uint8_t v = mem_peek(from + k);
+      mem_poke(dst++, v);
+      s1 += v;
+      s1 = (s1 & 0xff) + (s1 >> 8);
+      s2 += s1;
+      s2 = (s2 & 0xff) + (s2 >> 8);
+    }
+  }
+
+  mem_poke(cpu_addr(page + 0), src);
+  mem_poke(cpu_addr(page + 1), src >> 8);
+  mem_poke(cpu_addr(page + 2), src >> 16);
+  mem_poke(cpu_addr(page + 3), src >> 24);
+  mem_poke(cpu_addr(page + 4), dst);
+  mem_poke(cpu_addr(page + 5), dst >> 8);
+  mem_poke(cpu_addr(page + 6), dst >> 16);
+  mem_poke(cpu_addr(page + 7), dst >> 24);
+  mem_poke(cpu_addr(page + 12), s1);
+  mem_poke(cpu_addr(page + 13), s2);
+  cpu.pc = page + unlzroutine_idle;
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// the dma
+
+// runs the chain of enhanced dma jobs at 'list': options (only the F018A/B
+// formats and the source/destination megabytes are looked at), then a copy
+// or fill job
+static void run_dma(uint32_t list)
+{
+  for (;;)
+  {
+    uint32_t src_mb = 0, dst_mb = 0;
+    bool f018b = false;
+    uint8_t opt;
+
+    while ((opt = mem_peek(list++)) != 0x00)
+    {
+      if (opt == 0x0a || opt == 0x0b)
+        f018b = opt == 0x0b;
+      else if (opt & 0x80)
+      {
+        uint8_t val = mem_peek(list++);
+        if (opt == 0x80)
+          src_mb = val;
+        else if (opt == 0x81)
+          dst_mb = val;
+      }
+    }
+
+    uint8_t cmd = mem_peek(list);
+    int count = mem_peek(list + 1) | (mem_peek(list + 2) << 8);
+    uint32_t src = mem_peek(list + 3) | (mem_peek(list + 4) << 8) |
+      ((mem_peek(list + 5) & 0x0f) << 16) | (src_mb << 20);
+    uint32_t dst = mem_peek(list + 6) | (mem_peek(list + 7) << 8) |
+      ((mem_peek(list + 8) & 0x0f) << 16) | (dst_mb << 20);
+    list += f018b ? 12 : 11;
+
+    if (count == 0)
+      count = 0x10000;
+    for (int k = 0; k < count; k++)
+    {
+      if ((cmd & 0x03) == 0x00)
+        mem_poke(dst + k, mem_peek(src + k));
+      else if ((cmd & 0x03) == 0x03)
+        mem_poke(dst + k, src & 0xff);
+    }
+
+    if (!(cmd & 0x04))
+      break;
+  }
+}
+
+// if the pc is at a few instructions of straight-line code ending in a jmp to
+// itself, as m65dbg's temporary routines are, runs them (pha, pla, clv, nop,
+// lda #, sta abs), and any dma job a store to $D705 triggers. Returns true if
+// it did.
+static bool run_temp_routine(void)
+{
+  for (int pass = 0; pass < 2; pass++)
+  {
+    uint16_t pc = cpu.pc;
+    uint8_t a = cpu.a;
+    uint8_t stack[16];
+    int sp = 0;
+
+    for (int k = 0; ; k++)
+    {
+      uint8_t op = mem_peek(cpu_addr(pc));
+      uint16_t arg = cpu_peek16(pc + 1);
+
+      if (k == 32)
+        return false;
+      if (op == 0x4c && arg == pc)
+      {
+        if (pass == 1)
+        {
+          cpu.pc = pc;
+          cpu.a = a;
+        }
+        break;
+      }
+
+      if (op == 0x48 && sp < 16)
+        stack[sp++] = a;
+      else if (op == 0x68 && sp > 0)
+        a = stack[--sp];
+      else if (op == 0xa9)
+        a = arg & 0xff;
+      else if (op == 0x8d && pass == 1)
+      {
+        mem_poke(cpu_addr(arg), a);
+        if (arg == 0xd705)
+          run_dma(mem_peek(0xffd3704) << 20 | (mem_peek(0xffd3702) & 0x7f) << 16 |
+            mem_peek(0xffd3701) << 8 | a);
+      }
+      else if (op != 0x8d && op != 0xb8 && op != 0xea)
+        return false;
+
+      pc += op == 0xa9 ? 2 : op == 0x8d ? 3 : 1;
+    }
+  }
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// the monitor's commands
+
+static uint32_t load_addr;
+static int load_left;     // bytes of an 'l' upload still to come
+
+static const char* skip_spaces(const char* s)
+{
+  while (*s == ' ')
+    s++;
+  return s;
+}
+
+static void cmd_mem(uint32_t addr, int lines)
+{
+  addr &= 0xfffffff;
+  for (int l = 0; l < lines; l++, addr += 16)
+  {
+    out_printf("\r\n:%08X:", addr);
+    for (int k = 0; k < 16; k++)
+      out_printf("%02X", mem_peek(phys_addr(addr + k)));
+  }
+}
+
+// returns the number of jobs to run, if this was a write to the helper's $C000
+static int cmd_set(uint32_t addr, const char* s)
+{
+  int jobs = 0;
+  char* end;
+
+  for (s = skip_spaces(s); *s; s = skip_spaces(end))
+  {
+    unsigned long val = strtoul(s, &end, 16);
+    if (end == s)
+      break;
+    uint32_t a = phys_addr(addr++);
+    mem_poke(a, val);
+    if (a == 0xc000 && val != 0)
+      jobs = val;
+  }
+  return jobs;
+}
+
+static void do_command(char* line)
+{
+  int jobs = 0;
+  char* end;
+
+  stats.commands++;
+  out_printf("%s", line);
+
+  const char* s = skip_spaces(line);
+  char cmd = *s;
+  if (cmd)
+    s++;
+  unsigned long arg = strtoul(s, &end, 16);
+  bool has_arg = end != s;
+
+  switch (cmd)
+  {
+    case '\0':
+    case 't':
+      if (cmd == 't' && has_arg)
+      {
+        tracing = arg != 0;
+        if (!tracing && (run_pagesum() || run_unlz() || run_temp_routine()))
+          break;
+        if (!tracing && breakpoint >= 0)
+        {
+          cpu.pc = breakpoint;  // ran into it, and stopped there
+          tracing = true;
+        }
+        break;
+      }
+      if (tracing)
+      {
+        cpu_step(false);
+        show_regs();
+      }
+      break;
+
+    case 'N':
+      cpu_step(true);
+      show_regs();
+      break;
+
+    case 'r':
+      show_regs();
+      break;
+
+    case 'm':
+    case 'M':
+      if (!has_arg)
+        goto unknown;
+      cmd_mem(arg, cmd == 'm' ? 1 : 16);
+      break;
+
+    case 's':
+      if (!has_arg)
+        goto unknown;
+      jobs = cmd_set(arg, end);
+      break;
+
+    case 'S':
+      if (!has_arg)
+        goto unknown;
+      cmd_set(0x7770000 | (arg & 0xffff), end);
+      break;
+
+    case 'l':
+    {
+      unsigned long last = strtoul(end, NULL, 16);
+      if (!has_arg)
+        goto unknown;
+      load_addr = phys_addr(arg);
+      load_left = (last - arg) & 0xffff;
+      if (load_left == 0)
+        load_left = 0x10000;
+      out_printf("\r\n");
+      return;   // the prompt follows the upload
+    }
+
+    case 'g':
+      if (!has_arg)
+        goto unknown;
+      cpu.pc = arg;
+      helper_running = arg == HELPER_ENTRY;
+      break;
+
+    case 'b':
+      breakpoint = has_arg ? (int)(arg & 0xffff) : -1;
+      break;
+
+    case 'z':
+      for (int k = 1; k <= HISTORY_LEN; k++)
+        out_printf("\r\n%04X", history[(history_pos + HISTORY_LEN - k) % HISTORY_LEN]);
+      break;
+
+    case '!':
+      cpu_reset();
+      break;
+
+    case '+':
+    case '#':
+      break;
+
+    case '?':
+      out_printf("\r\nm65mon-sim: r m M s S l t N b g z ! + # ?");
+      break;
+
+    default:
+    unknown:
+      out_printf("\r\n?");
+      break;
+  }
+
+  out_printf("\r\n.");
+
+  // the helper picks up its jobs once the monitor is done with the command
+  if (jobs && helper_running && !tracing)
+    run_jobs(jobs);
+}
+
+static void serve(void)
+{
+  uint8_t buf[4096];
+  char line[1024];
+  int line_len = 0;
+  bool last_cr = false;
+  long long start = now_ns();
+
+  memset(&stats, 0, sizeof(stats));
+  rx_free_ns = tx_free_ns = 0;
+  load_left = 0;
+
+  for (;;)
+  {
+    int n = recv(client, buf, sizeof(buf), 0);
+    if (n <= 0)
+      break;
+    link_pace(&rx_free_ns, n);
+    stats.bytes_in += n;
+
+    for (int i = 0; i < n; i++)
+    {
+      if (load_left)
+      {
+        int k = n - i;
+        if (k > load_left)
+          k = load_left;
+        for (int j = 0; j < k; j++)
+          mem_poke(load_addr++, buf[i + j]);
+        i += k - 1;
+        load_left -= k;
+        if (load_left == 0)
+          out_printf("\r\n.");
+        last_cr = false;
+        continue;
+      }
+
+      uint8_t c = buf[i];
+      if (c == '\n' && last_cr)
+      {
+        last_cr = false;
+        continue;   // the second half of a CR LF
+      }
+      last_cr = c == '\r';
+
+      if (c == '\r' || c == '\n')
+      {
+        line[line_len] = '\0';
+        do_command(line);
+        line_len = 0;
+      }
+      else if (c >= ' ' && line_len < (int)sizeof(line) - 1)
+        line[line_len++] = c;
+    }
+    out_flush();
+  }
+
+  long long us = (now_ns() - start) / 1000;
+  printf("Connection closed: %d commands, %lld bytes in, %lld bytes out in %lld.%03llds\n",
+    stats.commands, stats.bytes_in, stats.bytes_out, us / 1000000, us / 1000 % 1000);
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+  const char* sock_path = "m65mon.sock";
+
+  for (int k = 1; k < argc; k++)
+  {
+    if (strcmp(argv[k], "--help") == 0 ||
+        strcmp(argv[k], "-h") == 0)
+    {
+      printf("m65mon-sim [-s <socket>] [-b <bps> | -d <nsec>] [-g <pc>] [-S <sdcard.img>]\n"
+             "           [<addr28>:<file> | <file.prg>] ...\n"
+             "-s <socket> = unix-domain socket to listen on (default 'm65mon.sock')\n"
+             "-b <bps> = simulate a link at this many bits/sec (eg, 2000000)\n"
+             "-d <nsec> = or set the link's per-byte delay directly\n"
+             "-g <pc> = the cpu's initial PC, in hex (default 0801)\n"
+             "-S <sdcard.img> = sd-card image for the ftp helper's jobs\n"
+             "<addr28>:<file> = load a raw file at a (hex) 28-bit address\n"
+             "<file.prg> = load a .prg at its load address\n");
+      exit(0);
+    }
+    else if (k + 1 < argc && strcmp(argv[k], "-s") == 0)
+      sock_path = argv[++k];
+    else if (k + 1 < argc && strcmp(argv[k], "-b") == 0)
+    {
+      long bps = atol(argv[++k]);
+      byte_ns = bps > 0 ? 10000000000LL / bps : 0;
+    }
+    else if (k + 1 < argc && strcmp(argv[k], "-d") == 0)
+      byte_ns = atol(argv[++k]);
+    else if (k + 1 < argc && strcmp(argv[k], "-g") == 0)
+      reset_pc = strtoul(argv[++k], NULL, 16);
+    else if (k + 1 < argc && strcmp(argv[k], "-S") == 0)
+    {
+      k++;
+      sdcard = fopen(argv[k], "r+b");
+      if (sdcard == NULL)
+      {
+        printf("Could not open sd-card image '%s'\n", argv[k]);
+        exit(1);
+      }
+    }
+    else if (!load_image(argv[k]))
+      exit(1);
+  }
+
+  // what m65dbg looks at to decide the machine is sitting in C64 mode
+  mem_poke(0xffd3061, 0x04);  // screen at $0400
+  if (pages[0] == NULL || mem_peek(0x0001) == 0)
+  {
+    mem_poke(0x0000, 0x2f);
+    mem_poke(0x0001, 0x37);
+  }
+
+  cpu_reset();
+  signal(SIGPIPE, SIG_IGN);
+
+  struct sockaddr_un sock_st;
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0)
+  {
+    printf("error %d creating UNIX-domain socket: %s\n", errno, strerror(errno));
+    return 1;
+  }
+  memset(&sock_st, 0, sizeof(sock_st));
+  sock_st.sun_family = AF_UNIX;
+  strncpy(sock_st.sun_path, sock_path, sizeof(sock_st.sun_path) - 1);
+  unlink(sock_path);
+  if (bind(server, (struct sockaddr*)&sock_st, sizeof(sock_st)) || listen(server, 1))
+  {
+    printf("error %d listening on %s: %s\n", errno, sock_path, strerror(errno));
+    return 1;
+  }
+
+  if (byte_ns)
+    printf("Listening on %s (%lld nsec/byte, ~%lld bps)\n", sock_path, byte_ns, 10000000000LL / byte_ns);
+  else
+    printf("Listening on %s\n", sock_path);
+  fflush(stdout);
+
+  for (;;)
+  {
+    client = accept(server, NULL, NULL);
+    if (client < 0)
+      continue;
+    serve();
+    close(client);
+    fflush(stdout);
+  }
+
+  return 0;
+}
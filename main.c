@@ -14,12 +14,14 @@
 #include <unistd.h>
 #include "serial.h"
 #include "commands.h"
+#include "transport.h"
 
 #define VERSION "v1.00"
 
 char *strInput = NULL;
 char pathBitstream[256] = "";
 char devSerial[100] = "/dev/ttyUSB1";
+char recordPath[256] = "";
 
 /**
  * retrieves a command via user input and places it in global strInput
@@ -49,6 +51,11 @@ void parse_command(void)
   if (strlen(strInput) == 0)
     return;
 
+  // memory cached by the last command is only good for this one too if the
+  // cpu has been stopped since
+  if (cpu_running)
+    mem_epoch++;
+
   // preserve a copy of original command
   strcpy(outbuf, strInput);
 
@@ -111,6 +118,13 @@ void ctrlc_handler(int s)
   ctrlcflag = true;
 }
 
+// closes the link on the way out (the exit()s in the helper code too), so a
+// recording is complete
+void close_link(void)
+{
+  serialClose();
+}
+
 extern BitfieldInfo bitfields[];
 extern hyppo_det hyppo_services[];
 
@@ -156,27 +170,23 @@ char* hyppo_service_gen(const char* text, int state)
 char* my_generator(const char* text, int state)
 {
   static int len;
-  static type_symmap_entry* iter = NULL;
+  static int sym_idx = 0;
   static int cmd_idx = 0;
 
   if( !state )
   {
     len = strlen(text);
-    iter = lstSymMap;
+    sym_idx = 0;
     cmd_idx = 0;
   }
 
   // check if it is a symbol name
-  while(iter != NULL)
+  type_symmap_entry* sme;
+  while((sme = symtab_at(&symMap, sym_idx)) != NULL)
   {
-    if( strncmp(iter->symbol, text, len) == 0 )
-    {
-      char *s = strdup(iter->symbol);
-      iter = iter->next;
-      return s;
-    }
-
-    iter = iter->next;
+    sym_idx++;
+    if( strncmp(sme->symbol, text, len) == 0 )
+      return strdup(sme->symbol);
   }
 
   while (cmd_idx < cmdGetCmdCount())
@@ -293,7 +303,10 @@ int main(int argc, char** argv)
     {
       printf("--help/-h = display this help\n"
              "--device/-l </dev/tty*> = select a tty device-name to use as the serial port to communicate with the Nexys hardware\n"
-             "-b <bistream.bit> = Name of bitstream file to load (needed for ftp support)\n");
+             "-b <bistream.bit> = Name of bitstream file to load (needed for ftp support)\n"
+             "--record <file> = record all traffic with the mega65 to <file>, for replaying later\n"
+             "                  with '-l replay#<file>' (or '-l replay-timed#<file>')\n"
+             "-v = show how long each list/map file took to parse at startup (and on 'reload')\n");
       exit(0);
     }
     if (strcmp(argv[k], "--device") == 0 ||
@@ -308,6 +321,20 @@ int main(int argc, char** argv)
       strcpy(devSerial, argv[k]);
     }
 
+    if (strcmp(argv[k], "--record") == 0)
+    {
+      if (k+1 >= argc)
+      {
+        printf("Please provide a file to record to\n");
+        exit(0);
+      }
+      k++;
+      strcpy(recordPath, argv[k]);
+    }
+
+    if (strcmp(argv[k], "-v") == 0)
+      load_verbose = true;
+
     if (strcmp(argv[k], "-b") == 0)
     {
       if (k+1 >= argc)
@@ -321,8 +348,11 @@ int main(int argc, char** argv)
   }
 
   // open the serial port
+  if (recordPath[0] != '\0')
+    transport_record_path = recordPath;
   if (!serialOpen(devSerial))
     return 1;
+  atexit(close_link);
 
   printf("- Type 'help' for new commands, '?'/'h' for raw commands.\n");
 
@@ -336,6 +366,9 @@ int main(int argc, char** argv)
 
     rl_attempted_completion_function = my_completion;
 
+    // pokes made by the last command (or the init files) shouldn't wait on the next one
+    poke_buffer_flush();
+
     get_command();
 
     if (!strInput ||
@@ -345,6 +378,7 @@ int main(int argc, char** argv)
         strcmp(strInput, "q") == 0)
     {
       write_history(history_file);
+      serialClose();
       return 0;
     }
 
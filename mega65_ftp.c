@@ -86,6 +86,7 @@ static const int B4000000 = 4000000;
 #endif
 
 #include "m65.h"
+#include "transport.h"
 
 static time_t start_time=0;
 long long start_usec=0;
@@ -122,6 +123,9 @@ extern unsigned char helperroutine[];
 int job_done;
 int sectors_written;
 int job_status_fresh=0;
+int helper_running=0;   // the helper routine is running on the target, taking jobs
+int helper_reads=0;     // use the helper for the debugger's bulk memory reads too
+static int queue_quiet=0;  // no progress messages (reads for the debugger's own commands)
 
 static int osk_enable=0;
 
@@ -239,17 +243,18 @@ int slow_write_ftp(int fd,char *d,int l,int preWait)
   //  printf("Writing [%s]\n",d);
   int i;
   usleep(preWait);
+  serialNoteCommand(d,l);
   for(i=0;i<l;i++)
   {
-    int w=write(fd,&d[i],1);
+    int w=serialport_write(fd,(uint8_t*)&d[i],1);
     while (w<1) {
       usleep(1000);
-      w=write(fd,&d[i],1);
+      w=serialport_write(fd,(uint8_t*)&d[i],1);
     }
     // Only control characters can cause us whole line delays,
     if (d[i]<' ') { usleep(2000); } else usleep(0);
   }
-  tcdrain(fd);
+  transport_drain(monitor_link);
   //printf("slow_write_ftp finished\n");
   return 0;
 }
@@ -334,50 +339,20 @@ int process_char(unsigned char c, int live)
 int process_waiting(int fd)
 {
   unsigned char  read_buff[1024];
-  int b=read(fd,read_buff,1024);
+  int b=transport_read(monitor_link,read_buff,1024,0);
   while (b>0) {
     int i;
     for(i=0;i<b;i++) {
       process_char(read_buff[i],1);
     }
-    b=read(fd,read_buff,1024);
+    b=transport_read(monitor_link,read_buff,1024,0);
   }
   return 0;
 }
 
 void set_speed(int fd,int serial_speed)
 {
-  struct termios t;
-  if (serial_speed==230400) {
-    if (cfsetospeed(&t, B230400)) perror("Failed to set output baud rate");
-    if (cfsetispeed(&t, B230400)) perror("Failed to set input baud rate");
-  } else if (serial_speed==2000000) {
-    if (cfsetospeed(&t, B2000000)) perror("Failed to set output baud rate");
-    if (cfsetispeed(&t, B2000000)) perror("Failed to set input baud rate");
-  } else if (serial_speed==1000000) {
-    if (cfsetospeed(&t, B1000000)) perror("Failed to set output baud rate");
-    if (cfsetispeed(&t, B1000000)) perror("Failed to set input baud rate");
-  } else if (serial_speed==1500000) {
-    if (cfsetospeed(&t, B1500000)) perror("Failed to set output baud rate");
-    if (cfsetispeed(&t, B1500000)) perror("Failed to set input baud rate");
-  }
-#ifndef __CYGWIN__
-  else {
-    if (cfsetospeed(&t, B4000000)) perror("Failed to set output baud rate");
-    if (cfsetispeed(&t, B4000000)) perror("Failed to set input baud rate");
-  }
-#endif
-  t.c_cflag &= ~PARENB;
-  t.c_cflag &= ~CSTOPB;
-  t.c_cflag &= ~CSIZE;
-  t.c_cflag &= ~CRTSCTS;
-  t.c_cflag |= CS8 | CLOCAL;
-  t.c_lflag &= ~(ICANON | ISIG | IEXTEN | ECHO | ECHOE);
-  t.c_iflag &= ~(BRKINT | ICRNL | IGNBRK | IGNCR | INLCR |
-      INPCK | ISTRIP | IXON | IXOFF | IXANY | PARMRK);
-  t.c_oflag &= ~OPOST;
-  if (tcsetattr(fd, TCSANOW, &t)) perror("Failed to set terminal parameters");
-
+  transport_set_speed(monitor_link,serial_speed);
 }
 
 int queued_command_count=0;
@@ -575,6 +550,7 @@ int do_ftp(char* bitstream)
   }
 
   slow_write_ftp(fd,"\r!\r",3,0); usleep(100000);
+  helper_running=0;
   set_speed(fd,2000000);
 #if !defined(__CYGWIN__) && !defined(__APPLE__)
   serial.flags -= ASYNC_LOW_LATENCY;
@@ -675,10 +651,6 @@ int sdhc_check(void)
   return sdhc;
 }
 
-extern unsigned char ram_cache[512*1024+255];
-extern unsigned char ram_cache_valids[512*1024+255];
-extern int ram_cache_initialised;
-
 int load_helper(void)
 {
   int retVal=0;
@@ -711,14 +683,7 @@ int load_helper(void)
       slow_write_ftp(fd,cmd,strlen(cmd),500);
       usleep(10000); // give uart monitor time to get ready for the data
       process_waiting(fd);
-      int offset=2;
-      while(offset<helperroutine_len) {
-        int written=write(fd,&helperroutine[offset],helperroutine_len-offset);
-        if (written!=helperroutine_len) {
-          usleep(10000);
-        }
-        offset+=written;
-      }
+      serialport_write(fd,&helperroutine[2],helperroutine_len-2);
       slow_write_ftp(fd,"\r",1,500);
       process_waiting(fd);
 
@@ -729,6 +694,7 @@ int load_helper(void)
       snprintf(cmd,1024,"t0\r");
       slow_write_ftp(fd,cmd,strlen(cmd),500);
 
+      helper_running=1;
       printf("\nNOTE: Fast SD card access routine installed.\n");
   } while(0);
   return retVal;
@@ -799,10 +765,11 @@ void queue_add_job(uint8_t *j,int len)
 
 }
 
-void job_process_results(void)
+int job_process_results(void)
 {
-  printf("job_process_results()...\n");
+  if (!queue_quiet) printf("job_process_results()...\n");
   long long now =gettime_us();
+  long long last_rx=now;
   queue_read_len=0;
   uint8_t buff[8192];
 
@@ -813,8 +780,13 @@ void job_process_results(void)
   int debug_rx=0;
 
   while (1) {
-    int b=read(fd,buff,8192);
-    if (b<1) usleep(0);
+    int b=serialport_read(fd,buff,8192);
+    if (b>0) last_rx=gettime_us();
+    else if (gettime_us()-last_rx>monitor_link->timeout_ms*1000LL) {
+      // the helper has stopped (or was never started)
+      fprintf(stderr,"ERROR: No response from the helper routine.\n");
+      return -1;
+    }
     if (b>0) if (debug_rx) dump_bytes(0,"jobresponse",buff,b);
     for(int i=0;i<b;i++) {
       // Keep rolling window of most recent chars for interpretting job
@@ -830,7 +802,7 @@ void job_process_results(void)
           long long endtime =gettime_us();
           if (debug_rx) printf("%lld: Saw end of batch job after %lld usec\n",endtime-start_usec,endtime-now);
           //    dump_bytes(0,"read data",queue_read_data,queue_read_len);
-          return;
+          return 0;
         }
         if (!strncmp((char*)recent,"FTJOBDONE:",10)) {
           int jn=atoi((char *)&recent[10]);
@@ -859,7 +831,7 @@ void job_process_results(void)
   }
 }
 
-void queue_execute(void)
+int queue_execute(void)
 {
   char cmd[1024];
 
@@ -878,11 +850,13 @@ void queue_execute(void)
   sprintf(cmd,"sc000 %x\r",queue_jobs);
   slow_write_ftp(fd,cmd,strlen(cmd),0);
   long long end = gettime_us();
+  if (!queue_quiet)
     printf("%lld Executing queued jobs (took %lld us to dispatch)\n",end-start_usec,end-start);
 
-  job_process_results();
+  int retVal=job_process_results();
   queue_addr=0xc001;
   queue_jobs=0;
+  return retVal;
 }
 
 uint32_t write_buffer_offset=0;
@@ -917,13 +891,7 @@ int execute_write_queue(void)
     //    printf("CMD: '%s'\n",cmd);
     slow_write_ftp(fd,cmd,strlen(cmd),1000);
     usleep(5000);
-    int offset=0;
-    while (offset<write_buffer_offset)
-    {
-      int written=write(fd,&write_data_buffer[offset],write_buffer_offset-offset);
-      if (written>0) offset+=written;
-      else usleep(0);
-    }
+    serialport_write(fd,write_data_buffer,write_buffer_offset);
     usleep(USLEEP_LCMD*write_buffer_offset);
 
     // XXX - Sort sector number order and merge consecutive writes into
@@ -999,6 +967,32 @@ void queue_read_mem(uint32_t mega65_address,uint32_t len)
 
 
 
+// Read a block of memory via the helper's read job (0x11), which sends it back
+// RLE packed binary, rather than the monitor's hex dump at ~2.7 bytes on the
+// wire per byte read. Returns -1 if the helper isn't available, so the caller
+// can fall back to the monitor.
+int helper_read_mem(uint32_t address,uint32_t len,uint8_t *buffer)
+{
+  if (!helper_running) return -1;
+
+  while(len) {
+    uint32_t n=len;
+    if (n>65536) n=65536;
+    queue_read_mem(address,n);
+    queue_quiet=1;
+    int failed=queue_execute();
+    queue_quiet=0;
+    if (failed||queue_read_len<n) {
+      fprintf(stderr,"WARNING: Helper read failed, falling back to the monitor.\n");
+      helper_running=0;
+      return -1;
+    }
+    bcopy(queue_read_data,buffer,n);
+    address+=n; buffer+=n; len-=n;
+  }
+  return 0;
+}
+
 #define SECTOR_CACHE_SIZE 4096
 int sector_cache_count=0;
 unsigned char sector_cache[SECTOR_CACHE_SIZE][512];
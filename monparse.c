@@ -0,0 +1,153 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * monparse.c - decoding of the serial monitor's fixed-format output lines.
+ *
+ * These run over every line of every memory read, and every register dump of
+ * a step/next/finish loop, so they're hand-rolled rather than going through
+ * sscanf/strtol.
+ * Each hex digit is a single table lookup, and rather than branching on every
+ * character, the lookups are or'ed together and checked once at the end
+ * (any invalid digit makes the result negative).
+ */
+
+#include <stdint.h>
+#include "monparse.h"
+
+const int8_t hex_digit[256] =
+{
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+  -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/**
+ * decodes two hex digits into a byte.
+ * returns the byte (0-255), or -1 if either char isn't a hex digit.
+ */
+int parse_hex_pair(const char* s)
+{
+  int hi = hex_digit[(uint8_t)s[0]];
+  int lo = hex_digit[(uint8_t)s[1]];
+  return (hi | lo) < 0 ? -1 : ((hi << 4) | lo);
+}
+
+/**
+ * parses a memory line of the form ":AAAAAAAA:" + 32 hex digits, as output by
+ * the monitor's 'm' and 'M' commands. 's' points at the leading ':' and holds
+ * 'len' chars (it needn't be null-terminated).
+ *
+ * returns the number of chars parsed (MEM_LINE_LEN), or -1 if the line is
+ * short or malformed, in which case addr/bytes are left untouched.
+ */
+int monparse_mem_line(const char* s, int len, uint32_t* addr, uint8_t* bytes)
+{
+  if (len < MEM_LINE_LEN || s[0] != ':' || s[9] != ':')
+    return -1;
+
+  const uint8_t* u = (const uint8_t*)s;
+  int bad = 0;
+  uint32_t a = 0;
+
+  for (int k = 1; k <= 8; k++)
+  {
+    int d = hex_digit[u[k]];
+    bad |= d;
+    a = (a << 4) | (d & 0x0f);
+  }
+
+  uint8_t b[16];
+  for (int k = 0; k < 16; k++)
+  {
+    int hi = hex_digit[u[10 + k*2]];
+    int lo = hex_digit[u[11 + k*2]];
+    bad |= hi | lo;
+    b[k] = (uint8_t)(((hi & 0x0f) << 4) | (lo & 0x0f));
+  }
+
+  if (bad < 0)
+    return -1;
+
+  *addr = a;
+  for (int k = 0; k < 16; k++)
+    bytes[k] = b[k];
+
+  return MEM_LINE_LEN;
+}
+
+/**
+ * parses up to 'count' space-separated hex fields, such as the register line
+ * output by the monitor's 'r' command. Each field is read as up to widths[k]
+ * hex digits, the way sscanf's "%04X" would. *s is left just past the last
+ * field parsed.
+ *
+ * returns the number of fields parsed, which is short of 'count' if the line
+ * ran out or a field held no hex digits.
+ */
+int monparse_hex_fields(const char** s, const int* widths, int count, int* values)
+{
+  const uint8_t* u = (const uint8_t*)*s;
+  int k;
+
+  for (k = 0; k < count; k++)
+  {
+    while (*u == ' ' || *u == '\t' || *u == '\r' || *u == '\n')
+      u++;
+
+    int v = 0;
+    int n = 0;
+    int d;
+    while (n < widths[k] && (d = hex_digit[u[n]]) >= 0)
+    {
+      v = (v << 4) | d;
+      n++;
+    }
+    if (n == 0)
+      break;
+
+    values[k] = v;
+    u += n;
+  }
+
+  *s = (const char*)u;
+  return k;
+}
+
+/**
+ * copies the next space-separated word (at most size-1 chars of it) into
+ * 'word', leaving *s just past it.
+ *
+ * returns the length of the word copied, 0 if there wasn't one.
+ */
+int monparse_word(const char** s, char* word, int size)
+{
+  const char* p = *s;
+  int n = 0;
+
+  while (*p == ' ' || *p == '\t')
+    p++;
+
+  while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+  {
+    if (n < size - 1)
+      word[n++] = *p;
+    p++;
+  }
+  word[n] = '\0';
+
+  *s = p;
+  return n;
+}
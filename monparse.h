@@ -0,0 +1,23 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * monparse.h - decoding of the serial monitor's fixed-format output lines.
+ */
+
+#ifndef MONPARSE_H
+#define MONPARSE_H
+
+#include <stdint.h>
+
+// ":AAAAAAAA:" followed by 16 hex pairs
+#define MEM_LINE_LEN 42
+
+// maps an ascii char to its hex digit value, or -1 if it isn't one
+extern const int8_t hex_digit[256];
+
+int parse_hex_pair(const char* s);
+int monparse_mem_line(const char* s, int len, uint32_t* addr, uint8_t* bytes);
+int monparse_hex_fields(const char** s, const int* widths, int count, int* values);
+int monparse_word(const char** s, char* word, int size);
+
+#endif // MONPARSE_H
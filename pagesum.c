@@ -0,0 +1,24 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+// pagesum.a65, assembled at $C010 (see there for how it's used)
+
+unsigned int pagesumroutine_len=135;
+unsigned char pagesumroutine[]={
+0x08,0x78,0xd8,0x48,0xda,0x5a,0xdb,0x7b,0x48,0xa9,0xc0,0x5b,0xa5,0x07,0xf0,0x6d,
+0xa9,0x00,0x85,0x00,0x85,0x04,0x85,0x05,0x85,0x06,0xa0,0x00,0xb1,0x08,0x85,0x01,
+0xc8,0xb1,0x08,0x85,0x02,0xc8,0xb1,0x08,0x85,0x03,0xa2,0xea,0xc9,0xff,0xd0,0x02,
+0xa2,0x18,0x8e,0x47,0xc0,0xa3,0x00,0xea,0xb2,0x00,0x18,0x65,0x04,0x69,0x00,0x85,
+0x04,0x18,0x65,0x05,0x69,0x00,0x85,0x05,0x18,0x65,0x06,0x69,0x00,0x85,0x06,0x1b,
+0xd0,0xe5,0xa0,0x00,0xa5,0x04,0x91,0x0a,0xc8,0xa5,0x05,0x91,0x0a,0xc8,0xa5,0x06,
+0x91,0x0a,0x18,0xa5,0x08,0x69,0x03,0x85,0x08,0x90,0x02,0xe6,0x09,0x18,0xa5,0x0a,
+0x69,0x03,0x85,0x0a,0x90,0x02,0xe6,0x0b,0xc6,0x07,0x4c,0x1c,0xc0,0x68,0x5b,0xfb,
+0x7a,0xfa,0x68,0x4c,0x93,0xc0,0x28
+};
+
+// offsets of the bytes holding the routine's page (ie, $C0), to move it elsewhere
+int pagesumroutine_relocs[]={ 10, 52, 124, 133, -1 };
+
+// offsets from the start of the page of its entry point, and of its idle loop
+// (the PLP that puts P back follows it)
+int pagesumroutine_entry=0x10;
+int pagesumroutine_idle=0x93;
@@ -489,15 +489,16 @@ void get_video_state(void)
     //screen_address,screen_width,screen_rows,screen_size,upper_case,screen_line_step);
   //fprintf(stderr,"charset_address=$%x\n",charset_address);
 
+  // (through the cache, so nothing read since the cpu last ran is fetched again)
   //fprintf(stderr,"Fetching screen data,"); fflush(stderr);
-  fetch_ram(screen_address,screen_size,screen_data);
+  fetch_ram_cacheable(screen_address,screen_size,screen_data);
   //fprintf(stderr,"colour data,");
   fflush(stderr);
-  fetch_ram(0xff80000+colour_address,screen_size,colour_data);
+  fetch_ram_cacheable(0xff80000+colour_address,screen_size,colour_data);
 
   //fprintf(stderr,"charset");
   fflush(stderr);
-  fetch_ram(charset_address,charset_size,char_data);
+  fetch_ram_cacheable(charset_address,charset_size,char_data);
 
   fprintf(stderr,"\nDone\n");
 
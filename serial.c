@@ -1,49 +1,20 @@
 /* vim: set expandtab shiftwidth=2 tabstop=2: */
 
-// serial code routine borrowed from:
-// http://stackoverflow.com/questions/6947413/how-to-open-read-and-write-from-serial-port-in-c
-
-
-// Note1: enable unix domain socket support is untested on Windows/Cygwin so
-// it's better to leave commented out by default ...
-// -------------------------------------------------
-// Note2 (GI): I'm leaving this always enabled now, as I've gotten
-// unix-sockets to work in winxp+cygwin
-#define SUPPORT_UNIX_DOMAIN_SOCKET
+/**
+ * serial.c - the debugger's lock-step command/response layer, sitting on top of
+ * the shared transport (see transport.c) to the mega65's serial monitor.
+ */
 
 #define _BSD_SOURCE _BSD_SOURCE
-#include <errno.h>
-#include <fcntl.h>
 #include <string.h>
 #include <strings.h>
-#include <termios.h>
-#include <unistd.h>
 #include <stdio.h>
-#include <sys/ioctl.h>
-#ifdef SUPPORT_UNIX_DOMAIN_SOCKET
-#include <sys/un.h>
-#include <sys/socket.h>
-#endif
-#include <netdb.h>
-#include <arpa/inet.h>
 #include "serial.h"
+#include "transport.h"
 
-#ifdef __APPLE__
-#include <sys/ioctl.h>
-#include <CoreFoundation/CoreFoundation.h>
-#include <IOKit/IOKitLib.h>
-#include <IOKit/serial/IOSerialKeys.h>
-#include <IOKit/serial/ioss.h>
-#include <IOKit/IOBSD.h>
-
-static const int B1000000 = 1000000;
-static const int B1500000 = 1500000;
-static const int B2000000 = 2000000;
-static const int B4000000 = 4000000;
-#endif
-
-// borrow this from commands.c
+// borrow these from commands.c
 extern int mpeek(unsigned int address);
+extern void poke_buffer_flush(void);
 
 int xemu_flag = 0;
 
@@ -57,185 +28,44 @@ PORT_TYPE fd=-1;
 
 bool unix_socket_flag = false;
 
-int set_interface_attribs (int fd, int speed, int parity)
-{
-  struct termios tty;
-  memset (&tty, 0, sizeof tty);
-  if (tcgetattr (fd, &tty) != 0)
-  {
-    error_message ("error %d from tcgetattr\n", errno);
-    return -1;
-  }
+// how many queued commands serialQueueRun() lets be in flight at once,
+// so we don't overrun the monitor's input buffer
+int serial_queue_window = 8;
 
-#ifdef __APPLE__
-  speed_t speed_apple = speed;
-  fprintf(stderr,"Setting serial speed to %d bps using OSX method.\n",speed); 
-  if (ioctl(fd, IOSSIOSPEED, &speed_apple) == -1) {
-    perror("Failed to set output baud rate using IOSSIOSPEED");
-  }
-  if (tcgetattr(fd, &tty)) perror("Failed to get terminal parameters");
-  cfmakeraw(&tty);
-  if (tcsetattr(fd, TCSANOW, &tty)) perror("Failed to set OSX terminal parameters");
-#else
-  cfsetospeed (&tty, speed);
-  cfsetispeed (&tty, speed);
-
-  tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;     // 8-bit chars
-  // disable IGNBRK for mismatched speed tests; otherwise receive break
-  // as \000 chars
-  tty.c_iflag &= ~IGNBRK;         // disable break processing
-  tty.c_lflag = 0;                // no signaling chars, no echo,
-                                  // no canonical processing
-  tty.c_oflag = 0;                // no remapping, no delays
-  tty.c_cc[VMIN]  = 0;            // read doesn't block
-  tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
-
-  tty.c_iflag &= ~(IXON | IXOFF | IXANY | ICRNL); // shut off xon/xoff ctrl
-
-  tty.c_cflag |= (CLOCAL | CREAD);// ignore modem controls,
-                                  // enable reading
-  tty.c_cflag &= ~(PARENB | PARODD);      // shut off parity
-  tty.c_cflag |= parity;
-  tty.c_cflag &= ~CSTOPB;
-  tty.c_cflag &= ~CRTSCTS;
-
-  if (tcsetattr (fd, TCSANOW, &tty) != 0)
-  {
-    error_message ("error %d from tcsetattr\n", errno);
-    return -1;
-  }
-#endif
+static char queue_cmds[SERIAL_QUEUE_MAX][128];
+static int queue_len = 0;
 
-  return 0;
-}
+// bumped whenever a command that could change the target's memory goes out to
+// the monitor, so that memory cached before it (see commands.c) is known stale
+int mem_epoch = 0;
 
-void set_blocking_serial (int fd, int should_block)
-{
-  struct termios tty;
-  memset (&tty, 0, sizeof tty);
-  if (tcgetattr (fd, &tty) != 0)
-  {
-    error_message ("error %d from tggetattr\n", errno);
-    return;
-  }
-
-  tty.c_cc[VMIN]  = should_block ? 2 : 0;
-  tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
+// the same, for the rom ($20000-$3FFFF), which only changes when it's loaded
+// (or a reset loads it afresh), or while it's made writable (see 'romw')
+int rom_epoch = 0;
 
-  if (tcsetattr (fd, TCSANOW, &tty) != 0)
-    error_message ("error %d setting term attributes\n", errno);
-}
-
-/*
-  borrowed from: https://www.binarytides.com/hostname-to-ip-address-c-sockets-linux/
-  Get ip from domain name
- */
+// the cpu was last set running (t0, reset), rather than stopped (t1), so its
+// memory can change under us at any time. Assume so until we know otherwise.
+bool cpu_running = true;
 
-int hostname_to_ip(char * hostname , char* ip)
-{
-  struct hostent *he;
-  struct in_addr **addr_list;
-  int i;
-
-  if ( (he = gethostbyname( hostname ) ) == NULL)
-  {
-    // get the host info
-    herror("gethostbyname");
-    return 1;
-  }
-
-  addr_list = (struct in_addr **) he->h_addr_list;
-
-  for(i = 0; addr_list[i] != NULL; i++)
-  {
-    //Return the first one;
-    strcpy(ip , inet_ntoa(*addr_list[i]) );
-    return 0;
-  }
-
-  return 1;
-}
+// monitor commands that only look at the target
+#define READONLY_COMMANDS "mMdDr?z#"
 
 /**
  * opens the desired serial port at the required 2000000 bps, or to a unix-domain socket
  *
  * portname = the desired "/dev/ttyS*" device portname to use
  *            "unix#..path.." defines a unix-domain named stream socket to connect to (emulator)
+ *            "tcp#host:port" defines a tcp/ip socket to connect to (emulator)
  */
 bool serialOpen(char* portname)
 {
-  if (!strncasecmp(portname, "tcp", 3))
-  {
-    char hostname[128] = "localhost";
-    int port = 4510;  // assume a default port of 4510
-    if (portname[3] == '#') // did user provide a hostname and port number?
-    {
-      sscanf(&portname[4], "%[^:]:%d", hostname, &port);
-    }
-    else if (portname[3] == '\\' && portname[4] == '#')
-    {
-      sscanf(&portname[5], "%[^:]:%d", hostname, &port);
-    }
-
-    struct sockaddr_in sock_st;
-    fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (fd < 0) {
-      error_message("error %d creating tcp/ip socket: %s\n", errno, strerror (errno));
-      return false;
-    }
-
-    char ip[100];
-
-    hostname_to_ip(hostname , ip);
-    printf("%s resolved to %s\n" , hostname , ip);
-
-    sock_st.sin_addr.s_addr = inet_addr(ip);
-    sock_st.sin_family = AF_INET;
-    sock_st.sin_port = htons(port);
-
-    if (connect(fd, (struct sockaddr*)&sock_st, sizeof(sock_st)) < 0)
-    {
-      error_message("error %d connecting to tcp/ip socket %s:%d: %s\n", errno, hostname, port, strerror (errno));
-      close(fd);
-      return false;
-    }
-  }
-  else if (!strncasecmp(portname, "unix#", 5) ||
-      !strncasecmp(portname, "unix\\#", 6)) {
-#ifdef SUPPORT_UNIX_DOMAIN_SOCKET
-    struct sockaddr_un sock_st;
-    fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (fd < 0) {
-      error_message("error %d creating UNIX-domain socket: %s\n", errno, strerror (errno));
-      return false;
-    }
-    unix_socket_flag = true;
-    sock_st.sun_family = AF_UNIX;
-    int hashloc = strchr(portname, '#') - portname;
-    strcpy(sock_st.sun_path, portname + hashloc + 1);
-    if (connect(fd, (struct sockaddr*)&sock_st, sizeof(struct sockaddr_un))) {
-      error_message("error %d connecting to UNIX-domain socket %s: %s\n", errno, portname + 5, strerror (errno));
-      close(fd);
-      return false;
-    }
-    //set_blocking_std (fd, 0);    // set no blocking
-#else
-    error_message("unix domain socket is not compiled in this time!\n");
+  monitor_link = transport_open(portname);
+  if (monitor_link == NULL)
     return false;
-#endif
-  } else {
-    fd = open (portname, O_RDWR | O_NOCTTY | O_SYNC);
-    if (fd < 0)
-    {
-          error_message ("error %d opening %s: %s\n", errno, portname, strerror (errno));
-          return false;
-    }
-    set_interface_attribs (fd, B2000000, 0);  // set speed to 2,000,000 bps, 8n1 (no parity)
-    set_blocking_serial (fd, 0);  // set no blocking
-    // borrowed this line from m65.c - set_serial_speed(), as it seems to set the
-    // non-blocking behaviour properly
-    //fcntl(fd,F_SETFL,fcntl(fd, F_GETFL, NULL)|O_NONBLOCK);
-  }
+
+  // keep these around for the code that still wants to know about the raw port
+  fd = monitor_link->fd;
+  unix_socket_flag = !strcmp(monitor_link->ops->name, "unix");
 
   xemu_flag = mpeek(0xffd360f) & 0x20 ? 0 : 1;
   if (xemu_flag)
@@ -250,9 +80,9 @@ void serialBaud(bool fastmode)
 {
 #ifndef __CYGWIN__
   if (fastmode)
-    set_interface_attribs(fd, B4000000, 0);
+    transport_set_speed(monitor_link, 4000000);
   else
-    set_interface_attribs(fd, B2000000, 0);
+    transport_set_speed(monitor_link, 2000000);
 #endif
 }
 
@@ -262,10 +92,10 @@ void serialBaud(bool fastmode)
  */
 bool serialClose(void)
 {
-  if (fd >= 0)
+  if (monitor_link != NULL)
   {
-    close(fd);
-    fd = 0;
+    transport_close(monitor_link);
+    fd = -1;
     return true;
   }
 
@@ -274,20 +104,73 @@ bool serialClose(void)
 
 void serialFlush(void)
 {
-  // http://stackoverflow.com/questions/13013387/clearing-the-serial-ports-buffer
-  //  sleep(2); //required to make flush work, for some reason (for USB serial ports?)
-//  tcflush(fd,TCIOFLUSH);
-
-  // I'll now try a 'manual' flush, to see if that works for Ralph's mac and my mac...
-  int bytes_available = 0;
-  static char tmp[16384];
-#ifdef FIONREAD
-  ioctl(fd, FIONREAD, &bytes_available);
-#else
-  ioctl(fd, TIOCINQ, &bytes_available);
-#endif
-  if (bytes_available > 0)
-    read(fd, tmp, bytes_available);
+  transport_flush(monitor_link);
+}
+
+/**
+ * whether an 'l' command with the given arguments ("<addr28> <end16>") loads
+ * anything into the rom (or it can't tell)
+ */
+static bool load_touches_rom(const char* args, int len)
+{
+  char str[40];
+  unsigned int start, end;
+
+  if (len > (int)sizeof(str) - 1)
+    len = sizeof(str) - 1;
+  memcpy(str, args, len);
+  str[len] = '\0';
+
+  if (sscanf(str, "%X %X", &start, &end) != 2)
+    return true;
+
+  start &= 0xfffffff;
+  end = (start & ~0xffff) | (end & 0xffff);
+  if (end <= start)
+    end += 0x10000;
+
+  return start < 0x40000 && end > 0x20000;
+}
+
+/**
+ * looks at each command in 'cmd' on its way to the monitor, and bumps the
+ * memory epoch for anything but the read-only ones (a poke, load, step, go,
+ * trace on/off, reset, or a blank line, which steps when tracing)
+ */
+void serialNoteCommand(const char* cmd, int len)
+{
+  bool line_start = true;
+
+  for (int k = 0; k < len; k++)
+  {
+    char c = cmd[k];
+    if (c == ' ' && line_start)
+      continue;
+    if (c == '\r' || c == '\n')
+    {
+      if (line_start)
+        mem_epoch++;  // blank line
+      line_start = true;
+      continue;
+    }
+    if (!line_start)
+      continue;
+    line_start = false;
+
+    if (strchr(READONLY_COMMANDS, c) != NULL)
+      continue;
+
+    mem_epoch++;
+    if (c == 't' && k + 1 < len && (cmd[k+1] == '0' || cmd[k+1] == '1'))
+      cpu_running = cmd[k+1] == '0';
+    else if (c == '!')
+    {
+      cpu_running = true;
+      rom_epoch++;
+    }
+    else if (c == 'l' && load_touches_rom(&cmd[k+1], len - k - 1))
+      rom_epoch++;
+  }
 }
 
 /**
@@ -295,6 +178,8 @@ void serialFlush(void)
  */
 void serialWrite(char* string)
 {
+  // any writes still buffered have to reach the target first
+  poke_buffer_flush();
   serialFlush();
 
   int i = strlen(string);
@@ -305,63 +190,225 @@ void serialWrite(char* string)
     i++;
   }
 
-  write (fd, string, i);           // send string
-
-  // add a pause for xemu
-  if (xemu_flag)
-    usleep(10000);
+  serialNoteCommand(string, i);
+  transport_write(monitor_link, string, i);           // send string
 }
 
 
+/**
+ * looks through the buffered response data from 'scanned' onwards, for the '\n.'
+ * that marks the monitor's prompt.
+ *
+ * returns the offset of the '.', or -1 if it hasn't arrived yet.
+ */
+static int find_prompt(const uint8_t* data, int len, int scanned, bool* foundLF)
+{
+  for (int k = scanned; k < len; k++)
+  {
+    if (data[k] == '\n')
+      *foundLF = true;
+    else if (*foundLF && data[k] == '.')
+    {
+      *foundLF = false;
+      return k;
+    }
+    else
+      *foundLF = false;
+  }
+
+  return -1;
+}
+
 /**
  * reads serial data and feeds it into the provided buffer. The routine will read up
  * until the next '.' prompt. It should also crop out the first line, which is just
  * and echo of the command.
  *
+ * Rather than sleeping and hoping the response has arrived, it waits on the link and
+ * returns the moment the prompt shows up. If nothing arrives for the link's timeout,
+ * it reports a timeout. Anything after the prompt stays buffered in the transport.
+ *
  * returns:
  *   true = read till the next '.' prompt.
- *   false = could not read till next '.' prompt (eg, buffer was filled)
+ *   false = could not read till next '.' prompt (eg, buffer was filled, or timed out)
  */
 bool serialRead(char* buf, int bufsize)
 {
-  char* ptr = buf;
-  char* secondline = NULL;
+  transport* t = monitor_link;
+  const uint8_t* data;
+  int len = 0;
+  int scanned = 0;
+  bool foundLF = false;
+
+  while (1)
+  {
+    len = transport_peek(t, &data);
+
+    int k = find_prompt(data, len, scanned, &foundLF);
+    if (k >= 0)
+    {
+      // crop the echo of the command
+      int start = 0;
+      while (start < k && data[start] != '\n')
+        start++;
+      if (start < k)
+        start++;
+
+      int n = k - start;
+      if (n > bufsize - 1)
+        n = bufsize - 1;
+      memcpy(buf, data + start, n);
+      buf[n] = '\0';
+
+      transport_consume(t, k + 1);
+      return true;
+    }
+    scanned = len;
+
+    if (len >= bufsize - 1 || len >= TRANSPORT_RXBUF_SIZE)
+      break;  // the buffer is full and still no prompt
+
+    int n = transport_fill(t, t->timeout_ms);
+    if (n == 0)
+    {
+      error_message("timed out waiting for monitor prompt (%d ms)\n", t->timeout_ms);
+      break;
+    }
+    if (n < 0)
+      break;
+  }
+
+  // hand back whatever did arrive
+  len = transport_peek(t, &data);
+  if (len > bufsize - 1)
+    len = bufsize - 1;
+  memcpy(buf, data, len);
+  buf[len] = '\0';
+  transport_consume(t, len);
+  return false;
+}
+
+/**
+ * adds a command to the pipelined command queue (a trailing '\n' is added if
+ * missing). Returns false if the queue is already full.
+ */
+bool serialQueue(char* cmd)
+{
+  if (queue_len >= SERIAL_QUEUE_MAX)
+    return false;
+
+  if (queue_len == 0)
+    poke_buffer_flush();
+
+  int len = strlen(cmd);
+  if (len > 0 && cmd[len-1] == '\n')
+    len--;
+  if (len > (int)sizeof(queue_cmds[0]) - 2)
+    len = sizeof(queue_cmds[0]) - 2;
+
+  memcpy(queue_cmds[queue_len], cmd, len);
+  queue_cmds[queue_len][len] = '\n';
+  queue_cmds[queue_len][len+1] = '\0';
+  serialNoteCommand(queue_cmds[queue_len], len+1);
+  queue_len++;
+
+  return true;
+}
+
+int serialQueueLength(void)
+{
+  return queue_len;
+}
+
+/**
+ * sends all queued commands, keeping up to serial_queue_window of them in
+ * flight, and splits the incoming stream at each '.' prompt. Each response
+ * is passed to the handler in the order the commands were queued.
+ *
+ * returns:
+ *   true = all responses were received
+ *   false = timed out or the connection failed (the queue is emptied regardless)
+ */
+bool serialQueueRun(serial_response_handler handler, void* ctx)
+{
+  static char response[65536];
+  transport* t = monitor_link;
+  const uint8_t* data;
+  int scanned = 0;     // bytes of the buffered data already checked for a prompt
   bool foundLF = false;
+  int sent = 0;
+  int done = 0;
+  bool success = true;
+
+  if (queue_len == 0)
+    return true;
 
-  // wait a millisecond first, to assure all of buffer has arrived
-  usleep(1000);
+  serialFlush();
 
-  while (ptr - buf < bufsize)
+  while (done < queue_len)
   {
-    int n = read (fd, ptr, bufsize);  // read up to 'bufsize' characters if ready to read
+    // top up the commands in flight
+    while (sent < queue_len && sent - done < serial_queue_window && success)
+    {
+      if (transport_write(t, queue_cmds[sent], strlen(queue_cmds[sent])) < 0)
+        success = false;
+      sent++;
+    }
+    if (!success)
+      break;
+
+    // split off every complete response we have so far
+    int len = transport_peek(t, &data);
+    int k;
+    while (done < queue_len && (k = find_prompt(data, len, scanned, &foundLF)) >= 0)
+    {
+      // crop the echo of the command
+      int start = 0;
+      while (start < k && data[start] != '\n')
+        start++;
+      if (start < k)
+        start++;
+
+      int n = k - start;
+      if (n > (int)sizeof(response) - 1)
+        n = sizeof(response) - 1;
+      memcpy(response, data + start, n);
+      response[n] = '\0';
+
+      transport_consume(t, k + 1);
+      len = transport_peek(t, &data);
+      scanned = 0;
+
+      if (handler)
+        handler(done, response, ctx);
+      done++;
+    }
+    if (done == queue_len)
+      break;
+    scanned = len;
 
-    if (n == -1)
-      return false;
+    // responses came in, so there's room to send more before waiting again
+    if (sent < queue_len && sent - done < serial_queue_window)
+      continue;
 
-    // check for "." prompt
-    for (int k = 0; k < n; k++)
+    if (len >= TRANSPORT_RXBUF_SIZE)
     {
-      if ( *(ptr+k) == '\n' )
-      {
-        foundLF = true;
-        if (!secondline)
-          secondline = ptr+k+1;
-      }
-      else if (foundLF && *(ptr+k) == '.')
-      {
-        *(ptr+k) = '\0';
-
-        int len = strlen(secondline) + 1;
-        for (int z = 0; z < len; z++)
-          *(buf+z) = *(secondline+z);
-        return true;
-      }
-      else
-        foundLF = false;
+      error_message("monitor response too large for command queue\n");
+      success = false;
+      break;
     }
 
-    ptr += n;
+    int n = transport_fill(t, t->timeout_ms);
+    if (n == 0)
+      error_message("timed out waiting for monitor prompt (%d of %d responses, %d ms)\n",
+          done, queue_len, t->timeout_ms);
+    if (n <= 0)
+    {
+      success = false;
+      break;
+    }
   }
 
-  return false;
+  queue_len = 0;
+  return success;
 }
@@ -18,3 +18,18 @@ void serialWrite(char* string);
 bool serialRead(char* buf, int bufsize);
 void serialBaud(bool fastmode);
 void serialFlush(void);
+void serialNoteCommand(const char* cmd, int len);
+
+extern int mem_epoch;
+extern int rom_epoch;
+extern bool cpu_running;
+
+// pipelined command queue: commands are put on the wire back to back and
+// each response (echo line cropped, like serialRead) is handed back in order
+#define SERIAL_QUEUE_MAX 256
+
+typedef void (*serial_response_handler)(int idx, char* response, void* ctx);
+
+bool serialQueue(char* cmd);
+int serialQueueLength(void);
+bool serialQueueRun(serial_response_handler handler, void* ctx);
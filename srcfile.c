@@ -0,0 +1,135 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * srcfile.c - the source files shown alongside the disassembly.
+ *
+ * Every stop shows the lines around the current one, so rather than reading
+ * the file from the top each time (and looking up the address of each line
+ * shown), each file is read in once, noting where its lines start, and the
+ * addresses of all its lines are worked out in one pass over the filelocs.
+ * Showing the lines around one is then just indexing into both.
+ *
+ * A file is read in again if its mtime (to the nanosecond) or size have
+ * changed (a stat is all it costs to check), and its addresses are worked out
+ * again if the filelocs have changed (by their version).
+ *
+ * The text is read into memory rather than mmap'd, as an assembler or editor
+ * truncating the file in place would have reads of the mapping fault.
+ */
+
+#define _BSD_SOURCE _BSD_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "srcfile.h"
+
+/**
+ * a file's mtime in nanoseconds, so a file rebuilt or edited within the same
+ * second (at the same size) still counts as changed
+ */
+long long stat_mtime_ns(const struct stat* st)
+{
+#ifdef __APPLE__
+  return st->st_mtimespec.tv_sec * 1000000000LL + st->st_mtimespec.tv_nsec;
+#else
+  return st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+#endif
+}
+
+static void free_text(type_srcfile* sf)
+{
+  free(sf->text);
+  free(sf->line_offs);
+  free(sf->line_addrs);
+  sf->text = NULL;
+  sf->line_offs = NULL;
+  sf->line_addrs = NULL;
+  sf->line_cnt = 0;
+}
+
+// reads the file in, and finds where its lines start
+static bool load_text(type_srcfile* sf, struct stat* st)
+{
+  FILE* f = fopen(sf->name, "rb");
+  if (f == NULL)
+    return false;
+
+  sf->text = malloc(st->st_size + 1);
+  int len = fread(sf->text, 1, st->st_size, f);
+  fclose(f);
+  sf->text[len] = '\0';
+  sf->mtime = stat_mtime_ns(st);
+  sf->size = st->st_size;
+
+  // (a last line with no newline still counts)
+  sf->line_cnt = 0;
+  for (int k = 0; k < len; k++)
+    if (sf->text[k] == '\n')
+      sf->line_cnt++;
+  if (len > 0 && sf->text[len - 1] != '\n')
+    sf->line_cnt++;
+
+  sf->line_offs = malloc((sf->line_cnt + 1) * sizeof(int));
+  sf->line_offs[0] = 0;
+  for (int k = 0, n = 1; k < len && n < sf->line_cnt; k++)
+    if (sf->text[k] == '\n')
+      sf->line_offs[n++] = k + 1;
+  sf->line_offs[sf->line_cnt] = len;
+
+  return true;
+}
+
+/**
+ * the source file 'name', with its lines and their addresses (from 'fls') up
+ * to date, or NULL if it can't be read
+ */
+type_srcfile* srcfile_get(type_srcfiles* sfs, const char* name, type_filelocs* fls)
+{
+  type_srcfile* sf;
+  struct stat st;
+
+  for (sf = sfs->files; sf != NULL; sf = sf->next)
+    if (strcmp(sf->name, name) == 0)
+      break;
+
+  if (stat(name, &st) != 0)
+    return NULL;
+
+  if (sf == NULL)
+  {
+    sf = calloc(1, sizeof(type_srcfile));
+    sf->name = strdup(name);
+    sf->next = sfs->files;
+    sfs->files = sf;
+  }
+
+  // rebuilt or edited since?
+  if (sf->text == NULL || sf->mtime != stat_mtime_ns(&st) || sf->size != st.st_size)
+  {
+    free_text(sf);
+    if (!load_text(sf, &st))
+      return NULL;
+  }
+
+  if (sf->line_addrs == NULL || sf->addrs_version != fls->version)
+  {
+    sf->line_addrs = realloc(sf->line_addrs, (sf->line_cnt + 1) * sizeof(int));
+    fileloc_line_addrs(fls, name, sf->line_addrs, sf->line_cnt);
+    sf->addrs_version = fls->version;
+  }
+
+  return sf;
+}
+
+void srcfile_clear(type_srcfiles* sfs)
+{
+  while (sfs->files != NULL)
+  {
+    type_srcfile* sf = sfs->files;
+    sfs->files = sf->next;
+    free_text(sf);
+    free(sf->name);
+    free(sf);
+  }
+}
@@ -0,0 +1,36 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * srcfile.h - the source files shown alongside the disassembly, with the
+ * offsets of their lines and the addresses of the code on them.
+ */
+
+#ifndef SRCFILE_H
+#define SRCFILE_H
+
+#include <sys/stat.h>
+#include "fileloc.h"
+
+typedef struct tsf
+{
+  char* name;
+  char* text;
+  int* line_offs;   // where each line starts (line n at [n-1]), then the end
+  int line_cnt;
+  int* line_addrs;  // the address of the code on each line, or -1
+  unsigned int addrs_version; // of the filelocs they came from
+  long long mtime;  // in nanoseconds (see stat_mtime_ns())
+  long long size;
+  struct tsf* next;
+} type_srcfile;
+
+typedef struct
+{
+  type_srcfile* files;
+} type_srcfiles;
+
+type_srcfile* srcfile_get(type_srcfiles* sfs, const char* name, type_filelocs* fls);
+void srcfile_clear(type_srcfiles* sfs);
+long long stat_mtime_ns(const struct stat* st);
+
+#endif // SRCFILE_H
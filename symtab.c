@@ -0,0 +1,235 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * symtab.c - the symbol table loaded from the list/map/label files.
+ *
+ * Big cc65/Calypsi projects have tens of thousands of labels, and every
+ * symbol in a command's arguments gets looked up by name, so the table is
+ * indexed two ways:
+ *
+ * - a hash of the names, for symtab_find()
+ * - an array of the entries sorted by address, for the reverse lookups (and
+ *   to walk them all in order). Adding to it just appends, and it's sorted
+ *   again (once) the next time it's needed, so loading a file is O(N log N)
+ *   rather than the O(N^2) of inserting each one in order.
+ *
+ * Where several entries share a name, the one found is the one that comes
+ * first by address, and of those, the last one added (as when they were kept
+ * in a sorted list, with each new one inserted ahead of its equals).
+ *
+ * The entries and their strings come out of an arena of big chunks, all freed
+ * at once by symtab_clear(). Entries dropped by symtab_remove_origin() are
+ * just unlinked, and their memory waits for the next clear.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+
+#define SYMTAB_CHUNK_SIZE 65536
+
+struct tsc
+{
+  struct tsc* next;
+  int used;
+  int size;
+  char data[];
+};
+
+static void* arena_alloc(type_symtab* st, int size)
+{
+  size = (size + 7) & ~7;
+
+  if (st->arena == NULL || st->arena->used + size > st->arena->size)
+  {
+    int chunk = size > SYMTAB_CHUNK_SIZE ? size : SYMTAB_CHUNK_SIZE;
+    type_symtab_chunk* c = malloc(sizeof(type_symtab_chunk) + chunk);
+    c->next = st->arena;
+    c->used = 0;
+    c->size = chunk;
+    st->arena = c;
+  }
+
+  void* p = &st->arena->data[st->arena->used];
+  st->arena->used += size;
+  return p;
+}
+
+static char* arena_strdup(type_symtab* st, const char* s)
+{
+  int len = strlen(s) + 1;
+  char* p = arena_alloc(st, len);
+  memcpy(p, s, len);
+  return p;
+}
+
+// FNV-1a
+static unsigned int hash_name(const char* s)
+{
+  unsigned int h = 2166136261u;
+  while (*s)
+    h = (h ^ (unsigned char)*s++) * 16777619u;
+  return h;
+}
+
+static void hash_insert(type_symtab* st, type_symmap_entry* e)
+{
+  unsigned int b = hash_name(e->symbol) & (st->bucket_cnt - 1);
+  e->hash_next = st->buckets[b];
+  st->buckets[b] = e;
+}
+
+// (re)builds the name index from the entries, with a bucket per entry or so
+static void hash_rebuild(type_symtab* st, int bucket_cnt)
+{
+  free(st->buckets);
+  st->bucket_cnt = bucket_cnt;
+  st->buckets = calloc(bucket_cnt, sizeof(type_symmap_entry*));
+  for (int k = 0; k < st->count; k++)
+    hash_insert(st, st->by_addr[k]);
+}
+
+// by address, then newest first
+static int cmp_entries(const void* a, const void* b)
+{
+  const type_symmap_entry* ea = *(const type_symmap_entry**)a;
+  const type_symmap_entry* eb = *(const type_symmap_entry**)b;
+
+  if (ea->addr != eb->addr)
+    return ea->addr < eb->addr ? -1 : 1;
+  return eb->seq - ea->seq;
+}
+
+static void sort_entries(type_symtab* st)
+{
+  if (!st->sorted)
+    qsort(st->by_addr, st->count, sizeof(type_symmap_entry*), cmp_entries);
+  st->sorted = true;
+}
+
+void symtab_add(type_symtab* st, const char* symbol, int addr, const char* sval, const char* origin)
+{
+  type_symmap_entry* e = arena_alloc(st, sizeof(type_symmap_entry));
+  e->symbol = arena_strdup(st, symbol);
+  e->addr = addr;
+  e->sval = arena_strdup(st, sval);
+  e->origin = origin;
+  e->seq = st->seq++;
+
+  if (st->count == st->size)
+  {
+    st->size = st->size ? st->size * 2 : 1024;
+    st->by_addr = realloc(st->by_addr, st->size * sizeof(type_symmap_entry*));
+  }
+  // still in order, if it goes on the end (newer ones go ahead of their equals)
+  if (st->count > 0 && addr <= st->by_addr[st->count - 1]->addr)
+    st->sorted = false;
+  st->by_addr[st->count++] = e;
+
+  if (st->count > st->bucket_cnt)
+    hash_rebuild(st, st->bucket_cnt ? st->bucket_cnt * 2 : 1024);
+  else
+    hash_insert(st, e);
+}
+
+type_symmap_entry* symtab_find(type_symtab* st, const char* symbol)
+{
+  type_symmap_entry* best = NULL;
+
+  if (st->bucket_cnt == 0)
+    return NULL;
+
+  for (type_symmap_entry* e = st->buckets[hash_name(symbol) & (st->bucket_cnt - 1)]; e != NULL; e = e->hash_next)
+  {
+    if (strcmp(e->symbol, symbol) != 0)
+      continue;
+    if (best == NULL || e->addr < best->addr || (e->addr == best->addr && e->seq > best->seq))
+      best = e;
+  }
+
+  return best;
+}
+
+/**
+ * returns the index (in address order) of the first entry at or after 'addr',
+ * or the count of entries if there's none
+ */
+int symtab_lower_bound(type_symtab* st, int addr)
+{
+  int lo = 0, hi = st->count;
+
+  sort_entries(st);
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (st->by_addr[mid]->addr < addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// the entry at 'idx' in address order, or NULL past the end
+type_symmap_entry* symtab_at(type_symtab* st, int idx)
+{
+  if (idx < 0 || idx >= st->count)
+    return NULL;
+
+  sort_entries(st);
+  return st->by_addr[idx];
+}
+
+void symtab_remove_origin(type_symtab* st, const char* origin)
+{
+  int n = 0;
+
+  for (int k = 0; k < st->count; k++)
+    if (st->by_addr[k]->origin != origin)
+      st->by_addr[n++] = st->by_addr[k];
+
+  if (n == st->count)
+    return;
+  st->count = n;
+  hash_rebuild(st, st->bucket_cnt);
+}
+
+// by the order they were added in
+static int cmp_seq(const void* a, const void* b)
+{
+  return (*(const type_symmap_entry**)a)->seq - (*(const type_symmap_entry**)b)->seq;
+}
+
+// the entries in the order they were added (an array for the caller to free)
+type_symmap_entry** symtab_in_order(type_symtab* st)
+{
+  type_symmap_entry** entries = malloc((st->count + 1) * sizeof(type_symmap_entry*));
+  memcpy(entries, st->by_addr, st->count * sizeof(type_symmap_entry*));
+  qsort(entries, st->count, sizeof(type_symmap_entry*), cmp_seq);
+  return entries;
+}
+
+// adds all of 'from' to 'st', in the order they were added to 'from'
+void symtab_merge(type_symtab* st, type_symtab* from)
+{
+  type_symmap_entry** entries = symtab_in_order(from);
+
+  for (int k = 0; k < from->count; k++)
+    symtab_add(st, entries[k]->symbol, entries[k]->addr, entries[k]->sval, entries[k]->origin);
+
+  free(entries);
+}
+
+void symtab_clear(type_symtab* st)
+{
+  while (st->arena != NULL)
+  {
+    type_symtab_chunk* c = st->arena;
+    st->arena = c->next;
+    free(c);
+  }
+
+  free(st->by_addr);
+  free(st->buckets);
+  memset(st, 0, sizeof(type_symtab));
+}
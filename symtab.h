@@ -0,0 +1,47 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * symtab.h - the symbol table loaded from the list/map/label files.
+ */
+
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include <stdbool.h>
+
+typedef struct tse
+{
+  char* symbol;
+  int addr;   // integer value of symbol
+  char* sval; // string value of symbol
+  const char* origin; // the debug file it was loaded from
+  int seq;    // the order it was added in
+  struct tse* hash_next;
+} type_symmap_entry;
+
+typedef struct tsc type_symtab_chunk;
+
+typedef struct
+{
+  type_symmap_entry** by_addr;  // by address (and newest first), once sorted
+  int count;
+  int size;
+  bool sorted;
+
+  type_symmap_entry** buckets;  // by name
+  int bucket_cnt;
+
+  int seq;
+  type_symtab_chunk* arena;
+} type_symtab;
+
+void symtab_add(type_symtab* st, const char* symbol, int addr, const char* sval, const char* origin);
+type_symmap_entry* symtab_find(type_symtab* st, const char* symbol);
+int symtab_lower_bound(type_symtab* st, int addr);
+type_symmap_entry* symtab_at(type_symtab* st, int idx);
+void symtab_remove_origin(type_symtab* st, const char* origin);
+type_symmap_entry** symtab_in_order(type_symtab* st);
+void symtab_merge(type_symtab* st, type_symtab* from);
+void symtab_clear(type_symtab* st);
+
+#endif // SYMTAB_H
@@ -0,0 +1,317 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * tap.c - recording of the traffic on a transport, and a "replay#" backend
+ * that plays a recording back in place of a real mega65 (or xemu).
+ *
+ * A recording is a small header followed by one record per write or read:
+ *
+ *   "M65TAP1\n"
+ *   'W' or 'R'     1 byte   (written by m65dbg / read from the monitor)
+ *   time           4 bytes  (usec since the link was opened, little-endian)
+ *   length         4 bytes  (little-endian)
+ *   data           'length' bytes
+ *
+ * To record, start m65dbg with "--record <file>". To replay it, open the port
+ * as "replay#<file>" (as fast as possible) or "replay-timed#<file>" (with the
+ * monitor's recorded response times).
+ *
+ * The replay backend matches what m65dbg writes against the recorded writes,
+ * and only hands out each recorded read once the writes that came before it
+ * have been made, so a session run with the same commands sees the same
+ * responses. If the writes stop matching the recording, it says so (once)
+ * and carries on.
+ */
+
+#define _BSD_SOURCE _BSD_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include "transport.h"
+
+#define TAP_MAGIC "M65TAP1\n"
+#define TAP_MAGIC_LEN 8
+
+const char* transport_record_path = NULL;
+
+static void put_le32(uint8_t* p, uint32_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const uint8_t* p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ---------------------------------------------------------------------------
+// recording
+
+bool transport_tap_open(transport* t, const char* path)
+{
+  t->tap = fopen(path, "wb");
+  if (t->tap == NULL)
+  {
+    printf("Could not open '%s' to record to\n", path);
+    return false;
+  }
+
+  fwrite(TAP_MAGIC, 1, TAP_MAGIC_LEN, t->tap);
+  t->tap_start_us = transport_time_us();
+  printf("Recording monitor traffic to '%s'\n", path);
+  return true;
+}
+
+void transport_tap_close(transport* t)
+{
+  if (t->tap == NULL)
+    return;
+
+  fclose(t->tap);
+  t->tap = NULL;
+}
+
+void transport_tap_record(transport* t, char dir, const uint8_t* buf, int len)
+{
+  uint8_t hdr[9];
+
+  hdr[0] = dir;
+  put_le32(&hdr[1], (uint32_t)(transport_time_us() - t->tap_start_us));
+  put_le32(&hdr[5], len);
+  fwrite(hdr, 1, sizeof(hdr), t->tap);
+  fwrite(buf, 1, len, t->tap);
+  // (so a session that crashes or gets killed is still recorded up to there)
+  fflush(t->tap);
+}
+
+// ---------------------------------------------------------------------------
+// replay# backend
+
+typedef struct
+{
+  char dir;
+  uint32_t time_us;
+  uint32_t len;
+  const uint8_t* data;
+} tap_record;
+
+typedef struct
+{
+  uint8_t* log;
+  tap_record* recs;
+  int count;
+
+  int wrec, woff;       // the next recorded write to match
+  int rrec, roff;       // the next recorded read to hand out
+
+  bool timed;
+  long long base_us;    // wall-clock time that recorded time 0 maps to
+  bool diverged;
+  bool ended;
+} replay_state;
+
+static bool replay_match(const char* portname)
+{
+  return !strncasecmp(portname, "replay#", 7) ||
+    !strncasecmp(portname, "replay-timed#", 13);
+}
+
+static bool replay_open(transport* t, const char* portname)
+{
+  const char* path = strchr(portname, '#') + 1;
+  FILE* f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    printf("Could not open recording '%s'\n", path);
+    return false;
+  }
+
+  replay_state* rs = (replay_state*)calloc(1, sizeof(replay_state));
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  rs->log = (uint8_t*)malloc(size);
+  size = fread(rs->log, 1, size, f);
+  fclose(f);
+
+  if (size < TAP_MAGIC_LEN || memcmp(rs->log, TAP_MAGIC, TAP_MAGIC_LEN) != 0)
+  {
+    printf("'%s' isn't an m65dbg recording\n", path);
+    free(rs->log);
+    free(rs);
+    return false;
+  }
+
+  // index the records
+  int cap = 1024;
+  rs->recs = (tap_record*)malloc(cap * sizeof(tap_record));
+  for (long pos = TAP_MAGIC_LEN; pos + 9 <= size; )
+  {
+    tap_record* r;
+    if (rs->count == cap)
+    {
+      cap *= 2;
+      rs->recs = (tap_record*)realloc(rs->recs, cap * sizeof(tap_record));
+    }
+    r = &rs->recs[rs->count];
+    r->dir = rs->log[pos];
+    r->time_us = get_le32(&rs->log[pos + 1]);
+    r->len = get_le32(&rs->log[pos + 5]);
+    r->data = &rs->log[pos + 9];
+    if (pos + 9 + r->len > size)
+      break;  // truncated recording
+    pos += 9 + r->len;
+    rs->count++;
+  }
+
+  rs->timed = !strncasecmp(portname, "replay-timed#", 13);
+  rs->base_us = transport_time_us();
+  t->priv = rs;
+
+  printf("Replaying %d records from '%s'%s\n", rs->count, path,
+    rs->timed ? " at recorded speed" : "");
+  return true;
+}
+
+static void replay_close(transport* t)
+{
+  replay_state* rs = (replay_state*)t->priv;
+  free(rs->recs);
+  free(rs->log);
+  free(rs);
+  t->priv = NULL;
+}
+
+// moves the read cursor on to the next recorded read with data left in it
+static void replay_next_read(replay_state* rs)
+{
+  while (rs->rrec < rs->count &&
+      (rs->recs[rs->rrec].dir != 'R' || rs->roff == rs->recs[rs->rrec].len))
+  {
+    rs->rrec++;
+    rs->roff = 0;
+  }
+}
+
+// moves the write cursor on to the next recorded write with data left in it
+static void replay_next_write(replay_state* rs)
+{
+  while (rs->wrec < rs->count &&
+      (rs->recs[rs->wrec].dir != 'W' || rs->woff == rs->recs[rs->wrec].len))
+  {
+    if (rs->recs[rs->wrec].dir == 'W')
+      rs->base_us = transport_time_us() - rs->recs[rs->wrec].time_us;
+    rs->wrec++;
+    rs->woff = 0;
+  }
+}
+
+/**
+ * how long until the next recorded read can be handed out:
+ *   0 = now
+ *  >0 = usecs to go (timed replay)
+ *  -1 = not until m65dbg writes more
+ *  -2 = the recording has run out
+ */
+static long long replay_due(replay_state* rs)
+{
+  replay_next_read(rs);
+  replay_next_write(rs);
+
+  if (rs->rrec >= rs->count)
+    return -2;
+  if (rs->rrec > rs->wrec)
+    return -1;
+  if (!rs->timed)
+    return 0;
+
+  long long due = rs->base_us + rs->recs[rs->rrec].time_us - transport_time_us();
+  return due > 0 ? due : 0;
+}
+
+static int replay_wait(transport* t, int timeout_ms)
+{
+  replay_state* rs = (replay_state*)t->priv;
+  long long due = replay_due(rs);
+
+  if (due == -2)
+  {
+    if (!rs->ended)
+      printf("replay: end of the recording\n");
+    rs->ended = true;
+    return -1;
+  }
+
+  // when waiting on a write, nothing will turn up, just like the real thing
+  if (due == -1 || due > timeout_ms * 1000LL)
+  {
+    usleep(timeout_ms * 1000);
+    return 0;
+  }
+
+  if (due > 0)
+    usleep(due);
+  return 1;
+}
+
+static int replay_read(transport* t, uint8_t* buf, int size)
+{
+  replay_state* rs = (replay_state*)t->priv;
+
+  if (replay_due(rs) != 0)
+    return 0;
+
+  tap_record* r = &rs->recs[rs->rrec];
+  int n = r->len - rs->roff;
+  if (n > size)
+    n = size;
+  memcpy(buf, r->data + rs->roff, n);
+  rs->roff += n;
+  return n;
+}
+
+static int replay_write(transport* t, const uint8_t* buf, int size)
+{
+  replay_state* rs = (replay_state*)t->priv;
+
+  for (int k = 0; k < size; k++)
+  {
+    replay_next_write(rs);
+    if (rs->wrec >= rs->count)
+    {
+      if (!rs->diverged)
+        printf("replay: writing past the end of the recording\n");
+      rs->diverged = true;
+      break;
+    }
+
+    tap_record* r = &rs->recs[rs->wrec];
+    if (r->data[rs->woff] != buf[k] && !rs->diverged)
+    {
+      printf("replay: diverged from the recording at record #%d (wrote $%02X, recorded $%02X)\n",
+        rs->wrec, buf[k], r->data[rs->woff]);
+      rs->diverged = true;
+    }
+    rs->woff++;
+  }
+  replay_next_write(rs);
+
+  return size;
+}
+
+const transport_ops replay_ops = {
+  "replay",
+  replay_match,
+  replay_open,
+  replay_close,
+  replay_wait,
+  replay_read,
+  replay_write,
+  NULL,
+  NULL
+};
@@ -0,0 +1,815 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * transport.c - the one connection to the mega65's serial monitor.
+ *
+ * serial.c (the debugger commands) and m65.c, screen_shot.c and mega65_ftp.c
+ * all talk through the transport opened here, so they share a single read-ahead
+ * buffer and byte counters, rather than each doing their own reads on the port
+ * and flushing away each other's data.
+ *
+ * Each kind of link (a tty device, "tcp#host:port", "unix#path", or a
+ * "replay#file" recording, see tap.c) is a backend that provides a
+ * transport_ops vtable. To add a new one, write its ops and add them to
+ * transport_backends[] below.
+ */
+
+// serial code routine borrowed from:
+// http://stackoverflow.com/questions/6947413/how-to-open-read-and-write-from-serial-port-in-c
+
+// Note1: enable unix domain socket support is untested on Windows/Cygwin so
+// it's better to leave commented out by default ...
+// -------------------------------------------------
+// Note2 (GI): I'm leaving this always enabled now, as I've gotten
+// unix-sockets to work in winxp+cygwin
+#define SUPPORT_UNIX_DOMAIN_SOCKET
+
+#define _BSD_SOURCE _BSD_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#ifdef SUPPORT_UNIX_DOMAIN_SOCKET
+#include <sys/un.h>
+#include <sys/socket.h>
+#endif
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "transport.h"
+
+#ifdef __APPLE__
+#include <sys/ioctl.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <IOKit/IOKitLib.h>
+#include <IOKit/serial/IOSerialKeys.h>
+#include <IOKit/serial/ioss.h>
+#include <IOKit/IOBSD.h>
+
+static const int B1000000 = 1000000;
+static const int B1500000 = 1500000;
+static const int B2000000 = 2000000;
+static const int B4000000 = 4000000;
+#endif
+
+#define error_message printf
+
+transport* monitor_link = NULL;
+
+long long transport_time_ms(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+long long transport_time_us(void)
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// ---------------------------------------------------------------------------
+// helpers shared by the fd-based backends
+
+/**
+ * waits for the link's fd to become readable.
+ *
+ * returns:
+ *   1 = readable
+ *   0 = timed out
+ *  -1 = error
+ */
+int transport_fd_wait(transport* t, int timeout_ms)
+{
+  struct pollfd pfd = { .fd = t->fd, .events = POLLIN };
+  int ret = poll(&pfd, 1, timeout_ms);
+
+  if (ret < 0)
+  {
+    if (errno == EINTR)
+      return 0;
+    error_message("error %d polling serial port: %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  return ret > 0 ? 1 : 0;
+}
+
+/**
+ * reads whatever is ready, without blocking.
+ *
+ * returns the number of bytes read, 0 if nothing was ready, or -1 if the
+ * link failed or was closed from the other end.
+ */
+int transport_fd_read(transport* t, uint8_t* buf, int size)
+{
+  int n = read(t->fd, buf, size);
+
+  if (n < 0)
+  {
+    if (errno == EAGAIN || errno == EINTR)
+      return 0;
+    error_message("error %d reading serial port: %s\n", errno, strerror(errno));
+    return -1;
+  }
+
+  // a socket that reads 0 bytes has been closed from the other end
+  if (n == 0 && !isatty(t->fd))
+  {
+    error_message("serial connection closed\n");
+    return -1;
+  }
+
+  return n;
+}
+
+/**
+ * writes all of the buffer, waiting for room whenever the fd is full.
+ *
+ * returns the number of bytes written, or -1 on error (including no room
+ * having come up within the link's timeout).
+ */
+int transport_fd_write(transport* t, const uint8_t* buf, int size)
+{
+  int offset = 0;
+
+  while (offset < size)
+  {
+    int w = write(t->fd, buf + offset, size - offset);
+    if (w > 0)
+    {
+      offset += w;
+      continue;
+    }
+
+    if (w < 0 && errno != EAGAIN && errno != EINTR)
+    {
+      error_message("error %d writing serial port: %s\n", errno, strerror(errno));
+      return -1;
+    }
+
+    struct pollfd pfd = { .fd = t->fd, .events = POLLOUT };
+    int ret = poll(&pfd, 1, t->timeout_ms);
+    if (ret == 0)
+    {
+      error_message("timed out writing serial port\n");
+      return -1;
+    }
+    if (ret < 0 && errno != EINTR)
+    {
+      error_message("error %d polling serial port: %s\n", errno, strerror(errno));
+      return -1;
+    }
+  }
+
+  return offset;
+}
+
+static void set_nonblocking(int fd)
+{
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, NULL) | O_NONBLOCK);
+}
+
+// ---------------------------------------------------------------------------
+// tty backend
+
+int set_interface_attribs (int fd, int speed, int parity)
+{
+  struct termios tty;
+  memset (&tty, 0, sizeof tty);
+  if (tcgetattr (fd, &tty) != 0)
+  {
+    error_message ("error %d from tcgetattr\n", errno);
+    return -1;
+  }
+
+#ifdef __APPLE__
+  speed_t speed_apple = speed;
+  fprintf(stderr,"Setting serial speed to %d bps using OSX method.\n",speed);
+  if (ioctl(fd, IOSSIOSPEED, &speed_apple) == -1) {
+    perror("Failed to set output baud rate using IOSSIOSPEED");
+  }
+  if (tcgetattr(fd, &tty)) perror("Failed to get terminal parameters");
+  cfmakeraw(&tty);
+  if (tcsetattr(fd, TCSANOW, &tty)) perror("Failed to set OSX terminal parameters");
+#else
+  cfsetospeed (&tty, speed);
+  cfsetispeed (&tty, speed);
+
+  tty.c_cflag = (tty.c_cflag & ~CSIZE) | CS8;     // 8-bit chars
+  // disable IGNBRK for mismatched speed tests; otherwise receive break
+  // as \000 chars
+  tty.c_iflag &= ~IGNBRK;         // disable break processing
+  tty.c_lflag = 0;                // no signaling chars, no echo,
+                                  // no canonical processing
+  tty.c_oflag = 0;                // no remapping, no delays
+  tty.c_cc[VMIN]  = 0;            // read doesn't block
+  tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
+
+  tty.c_iflag &= ~(IXON | IXOFF | IXANY | ICRNL); // shut off xon/xoff ctrl
+
+  tty.c_cflag |= (CLOCAL | CREAD);// ignore modem controls,
+                                  // enable reading
+  tty.c_cflag &= ~(PARENB | PARODD);      // shut off parity
+  tty.c_cflag |= parity;
+  tty.c_cflag &= ~CSTOPB;
+  tty.c_cflag &= ~CRTSCTS;
+
+  if (tcsetattr (fd, TCSANOW, &tty) != 0)
+  {
+    error_message ("error %d from tcsetattr\n", errno);
+    return -1;
+  }
+#endif
+
+  return 0;
+}
+
+void set_blocking_serial (int fd, int should_block)
+{
+  struct termios tty;
+  memset (&tty, 0, sizeof tty);
+  if (tcgetattr (fd, &tty) != 0)
+  {
+    error_message ("error %d from tggetattr\n", errno);
+    return;
+  }
+
+  tty.c_cc[VMIN]  = should_block ? 2 : 0;
+  tty.c_cc[VTIME] = 5;            // 0.5 seconds read timeout
+
+  if (tcsetattr (fd, TCSANOW, &tty) != 0)
+    error_message ("error %d setting term attributes\n", errno);
+}
+
+static bool tty_match(const char* portname)
+{
+  return true;  // anything that isn't a socket is assumed to be a device
+}
+
+static bool tty_set_speed(transport* t, int bps)
+{
+  int speed;
+
+  switch (bps)
+  {
+    case 230400:  speed = B230400;  break;
+    case 1000000: speed = B1000000; break;
+    case 1500000: speed = B1500000; break;
+#ifndef __CYGWIN__
+    case 4000000: speed = B4000000; break;
+#endif
+    default:      speed = B2000000; bps = 2000000; break;
+  }
+
+  if (set_interface_attribs(t->fd, speed, 0) != 0)
+    return false;
+  set_blocking_serial(t->fd, 0);
+  t->speed = bps;
+  t->char_us = (10 * 1000000 + bps - 1) / bps;  // 8n1 = 10 bits per char
+  t->byte_ns = (int)(10 * 1000000000LL / bps);
+  return true;
+}
+
+static bool tty_open(transport* t, const char* portname)
+{
+  t->fd = open (portname, O_RDWR | O_NOCTTY | O_SYNC);
+  if (t->fd < 0)
+  {
+    error_message ("error %d opening %s: %s\n", errno, portname, strerror (errno));
+    return false;
+  }
+  tty_set_speed(t, 2000000);  // set speed to 2,000,000 bps, 8n1 (no parity)
+  set_nonblocking(t->fd);     // all reads are poll()ed for, so never block in read()
+  return true;
+}
+
+static void fd_close(transport* t)
+{
+  close(t->fd);
+  t->fd = -1;
+}
+
+static void tty_drain(transport* t)
+{
+  tcdrain(t->fd);
+}
+
+static const transport_ops tty_ops = {
+  "tty",
+  tty_match,
+  tty_open,
+  fd_close,
+  transport_fd_wait,
+  transport_fd_read,
+  transport_fd_write,
+  tty_set_speed,
+  tty_drain
+};
+
+// ---------------------------------------------------------------------------
+// tcp# backend
+
+/*
+  borrowed from: https://www.binarytides.com/hostname-to-ip-address-c-sockets-linux/
+  Get ip from domain name
+ */
+
+int hostname_to_ip(char * hostname , char* ip)
+{
+  struct hostent *he;
+  struct in_addr **addr_list;
+  int i;
+
+  if ( (he = gethostbyname( hostname ) ) == NULL)
+  {
+    // get the host info
+    herror("gethostbyname");
+    return 1;
+  }
+
+  addr_list = (struct in_addr **) he->h_addr_list;
+
+  for(i = 0; addr_list[i] != NULL; i++)
+  {
+    //Return the first one;
+    strcpy(ip , inet_ntoa(*addr_list[i]) );
+    return 0;
+  }
+
+  return 1;
+}
+
+static bool tcp_match(const char* portname)
+{
+  return !strncasecmp(portname, "tcp", 3);
+}
+
+static bool tcp_open(transport* t, const char* portname)
+{
+  char hostname[128] = "localhost";
+  int port = 4510;  // assume a default port of 4510
+  if (portname[3] == '#') // did user provide a hostname and port number?
+  {
+    sscanf(&portname[4], "%[^:]:%d", hostname, &port);
+  }
+  else if (portname[3] == '\\' && portname[4] == '#')
+  {
+    sscanf(&portname[5], "%[^:]:%d", hostname, &port);
+  }
+
+  struct sockaddr_in sock_st;
+  t->fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (t->fd < 0) {
+    error_message("error %d creating tcp/ip socket: %s\n", errno, strerror (errno));
+    return false;
+  }
+
+  char ip[100];
+
+  hostname_to_ip(hostname , ip);
+  printf("%s resolved to %s\n" , hostname , ip);
+
+  sock_st.sin_addr.s_addr = inet_addr(ip);
+  sock_st.sin_family = AF_INET;
+  sock_st.sin_port = htons(port);
+
+  if (connect(t->fd, (struct sockaddr*)&sock_st, sizeof(sock_st)) < 0)
+  {
+    error_message("error %d connecting to tcp/ip socket %s:%d: %s\n", errno, hostname, port, strerror (errno));
+    close(t->fd);
+    return false;
+  }
+
+  // monitor commands are tiny, so don't let nagle hold them back
+  int one = 1;
+  setsockopt(t->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  set_nonblocking(t->fd);
+  return true;
+}
+
+static const transport_ops tcp_ops = {
+  "tcp",
+  tcp_match,
+  tcp_open,
+  fd_close,
+  transport_fd_wait,
+  transport_fd_read,
+  transport_fd_write,
+  NULL,
+  NULL
+};
+
+// ---------------------------------------------------------------------------
+// unix# backend
+
+static bool unix_match(const char* portname)
+{
+  return !strncasecmp(portname, "unix#", 5) ||
+    !strncasecmp(portname, "unix\\#", 6);
+}
+
+static bool unix_open(transport* t, const char* portname)
+{
+#ifdef SUPPORT_UNIX_DOMAIN_SOCKET
+  struct sockaddr_un sock_st;
+  t->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (t->fd < 0) {
+    error_message("error %d creating UNIX-domain socket: %s\n", errno, strerror (errno));
+    return false;
+  }
+  sock_st.sun_family = AF_UNIX;
+  int hashloc = strchr(portname, '#') - portname;
+  strcpy(sock_st.sun_path, portname + hashloc + 1);
+  if (connect(t->fd, (struct sockaddr*)&sock_st, sizeof(struct sockaddr_un))) {
+    error_message("error %d connecting to UNIX-domain socket %s: %s\n", errno, portname + 5, strerror (errno));
+    close(t->fd);
+    return false;
+  }
+  set_nonblocking(t->fd);
+  return true;
+#else
+  error_message("unix domain socket is not compiled in this time!\n");
+  return false;
+#endif
+}
+
+static const transport_ops unix_ops = {
+  "unix",
+  unix_match,
+  unix_open,
+  fd_close,
+  transport_fd_wait,
+  transport_fd_read,
+  transport_fd_write,
+  NULL,
+  NULL
+};
+
+// the first backend whose match() accepts the portname gets to open it
+static const transport_ops* transport_backends[] = {
+  &tcp_ops,
+  &unix_ops,
+  &replay_ops,
+  &tty_ops,   // catch-all, so keep it last
+  NULL
+};
+
+// ---------------------------------------------------------------------------
+
+/**
+ * opens a link to the monitor, picking the backend from the portname:
+ *
+ *   "tcp#host:port" = a tcp/ip socket (eg, xemu's remote monitor)
+ *   "unix#path"     = a unix-domain named stream socket (emulator)
+ *   "replay#file"   = a recording made with --record (see tap.c)
+ *   anything else   = a serial device, eg, "/dev/ttyUSB1", at 2,000,000 bps
+ */
+transport* transport_open(const char* portname)
+{
+  transport* t = (transport*)calloc(1, sizeof(transport));
+  t->fd = -1;
+  t->timeout_ms = 2000;
+  t->echo_us = 2000;  // a guess until we've timed a few echoes
+
+  for (int k = 0; transport_backends[k] != NULL; k++)
+  {
+    if (transport_backends[k]->match(portname))
+    {
+      t->ops = transport_backends[k];
+      break;
+    }
+  }
+
+  if (!t->ops->open(t, portname))
+  {
+    free(t);
+    return NULL;
+  }
+
+  if (transport_record_path != NULL)
+    transport_tap_open(t, transport_record_path);
+
+  return t;
+}
+
+void transport_close(transport* t)
+{
+  if (t == NULL)
+    return;
+
+  transport_tap_close(t);
+  t->ops->close(t);
+  if (monitor_link == t)
+    monitor_link = NULL;
+  free(t);
+}
+
+/**
+ * writes the whole buffer to the link.
+ *
+ * returns the number of bytes written, or -1 on error.
+ */
+int transport_write(transport* t, const void* buf, int len)
+{
+  int w = t->ops->write(t, (const uint8_t*)buf, len);
+  if (w > 0)
+  {
+    t->tx_bytes += w;
+    if (t->tap != NULL)
+      transport_tap_record(t, 'W', (const uint8_t*)buf, w);
+  }
+  return w;
+}
+
+// find the last few printable characters of a command, which the monitor
+// will echo back once it has taken the command in
+static int echo_key(const char* cmd, int len, char* key, int size)
+{
+  int keylen = 0;
+
+  // trailing spaces are left out, in case the echo doesn't bother with them
+  for (int k = len - 1; k >= 0 && keylen < size; k--)
+  {
+    if (keylen == 0 && cmd[k] == ' ')
+      continue;
+    if (cmd[k] >= ' ' && cmd[k] < 0x7f)
+      key[size - 1 - keylen++] = cmd[k];
+    else if (keylen > 0)
+      break;
+  }
+
+  memmove(key, key + size - keylen, keylen);
+  return keylen;
+}
+
+static bool contains(const uint8_t* data, int len, const char* key, int keylen)
+{
+  for (int k = 0; k + keylen <= len; k++)
+  {
+    if (data[k] == (uint8_t)key[0] && !memcmp(data + k, key, keylen))
+      return true;
+  }
+  return false;
+}
+
+// waits until 'key' shows up in the buffer somewhere past 'mark'
+static bool wait_for_echo(transport* t, int mark, const char* key, int keylen, int timeout_ms)
+{
+  long long deadline = transport_time_ms() + timeout_ms;
+
+  while (1)
+  {
+    const uint8_t* data;
+    int len = transport_peek(t, &data);
+
+    if (contains(data + mark, len - mark, key, keylen))
+      return true;
+
+    int remaining = (int)(deadline - transport_time_ms());
+    if (remaining <= 0 || transport_fill(t, remaining) <= 0)
+      return false;
+  }
+}
+
+/**
+ * writes a command for the monitor in a single write, then holds off until the
+ * monitor has echoed it back, so the next command can't trample on this one.
+ *
+ * The echo is left in the read-ahead buffer for whoever reads the response.
+ * If the command has nothing recognisable to echo, or the echo doesn't turn
+ * up, we wait out the link's character budget instead: the time the command
+ * takes on the wire plus the echo turnaround measured on earlier commands.
+ *
+ * returns the number of bytes written, or -1 on error.
+ */
+int transport_write_command(transport* t, const char* cmd, int len)
+{
+  char key[16];
+  int keylen = echo_key(cmd, len, key, sizeof(key));
+
+  // take in anything already on its way, so it can't be mistaken for our echo
+  while (transport_fill(t, 0) > 0)
+    ;
+  int mark = t->rxlen;
+
+  long long start = transport_time_us();
+  int w = transport_write(t, cmd, len);
+  if (w < 0)
+    return -1;
+
+  int wire_us = len * t->char_us;
+  int budget_us = wire_us + t->echo_us;
+
+  if (keylen > 0)
+  {
+    int timeout_ms = budget_us * 4 / 1000;
+    if (timeout_ms < 50)
+      timeout_ms = 50;
+
+    if (wait_for_echo(t, mark, key, keylen, timeout_ms))
+    {
+      int turnaround = (int)(transport_time_us() - start) - wire_us;
+      if (turnaround < 0)
+        turnaround = 0;
+      t->echo_us = (t->echo_us * 7 + turnaround) / 8;
+      return w;
+    }
+  }
+
+  long long remaining = start + budget_us - transport_time_us();
+  if (remaining > 0)
+    usleep(remaining);
+  return w;
+}
+
+/**
+ * writes a block of binary data the monitor is expecting (the payload of an l
+ * command), then waits for the prompt it gives once all of it has arrived.
+ *
+ * How long to wait for that comes from the upload rate measured on earlier
+ * payloads, so the wait tracks the real speed of the link.
+ *
+ * returns the number of bytes written, or -1 on error or if the monitor
+ * never came back.
+ */
+int transport_write_payload(transport* t, const void* buf, int len)
+{
+  // take in anything already on its way, so an older prompt can't fool us
+  while (transport_fill(t, 0) > 0)
+    ;
+  int mark = t->rxlen;
+
+  long long start = transport_time_us();
+  int w = transport_write(t, buf, len);
+  if (w < 0)
+    return -1;
+
+  int timeout_ms = (int)(((long long)len * t->byte_ns / 1000 + t->echo_us) * 4 / 1000);
+  if (timeout_ms < t->timeout_ms)
+    timeout_ms = t->timeout_ms;
+  long long deadline = transport_time_ms() + timeout_ms;
+
+  // the prompt's '\n' may have come in with the command's echo
+  int from = mark > 0 ? mark - 1 : 0;
+
+  while (1)
+  {
+    const uint8_t* data;
+    int buffered = transport_peek(t, &data);
+
+    for (int k = from; k + 1 < buffered; k++)
+    {
+      if (data[k] == '\n' && data[k + 1] == '.')
+      {
+        long long took_us = transport_time_us() - start - t->echo_us;
+        if (len >= 256 && took_us > 0)
+          t->byte_ns = (int)((t->byte_ns * 3LL + took_us * 1000 / len) / 4);
+        transport_consume(t, k + 2);
+        return w;
+      }
+    }
+
+    int remaining = (int)(deadline - transport_time_ms());
+    if (remaining <= 0 || transport_fill(t, remaining) <= 0)
+      break;
+  }
+
+  error_message("timed out waiting for the monitor to take %d bytes (%d ms)\n", len, timeout_ms);
+  return -1;
+}
+
+/**
+ * pulls whatever the link has ready into the read-ahead buffer, waiting up to
+ * timeout_ms for something to arrive.
+ *
+ * returns:
+ *   >0 = number of bytes added to the buffer
+ *    0 = nothing arrived in time (or the buffer is full)
+ *   -1 = the link failed
+ */
+int transport_fill(transport* t, int timeout_ms)
+{
+  // make room at the end of the buffer
+  if (t->rxpos > 0 && t->rxpos + t->rxlen == TRANSPORT_RXBUF_SIZE)
+  {
+    memmove(t->rxbuf, t->rxbuf + t->rxpos, t->rxlen);
+    t->rxpos = 0;
+  }
+
+  int room = TRANSPORT_RXBUF_SIZE - (t->rxpos + t->rxlen);
+  if (room == 0)
+    return 0;
+
+  long long deadline = transport_time_ms() + timeout_ms;
+
+  while (1)
+  {
+    int n = t->ops->read(t, t->rxbuf + t->rxpos + t->rxlen, room);
+    if (n > 0)
+    {
+      if (t->tap != NULL)
+        transport_tap_record(t, 'R', t->rxbuf + t->rxpos + t->rxlen, n);
+      t->rxlen += n;
+      t->rx_bytes += n;
+      return n;
+    }
+    if (n < 0)
+      return -1;
+
+    int remaining = (int)(deadline - transport_time_ms());
+    if (remaining <= 0)
+      return 0;
+
+    if (t->ops->wait(t, remaining) < 0)
+      return -1;
+  }
+}
+
+/**
+ * gives access to the buffered data without consuming it.
+ * returns the number of bytes buffered.
+ */
+int transport_peek(transport* t, const uint8_t** data)
+{
+  *data = t->rxbuf + t->rxpos;
+  return t->rxlen;
+}
+
+void transport_consume(transport* t, int n)
+{
+  if (n > t->rxlen)
+    n = t->rxlen;
+
+  t->rxpos += n;
+  t->rxlen -= n;
+  if (t->rxlen == 0)
+    t->rxpos = 0;
+}
+
+/**
+ * reads up to 'size' bytes, serving the read-ahead buffer first. If nothing is
+ * buffered, waits up to timeout_ms (0 = don't wait) for data to arrive.
+ *
+ * returns the number of bytes read, 0 if none, or -1 if the link failed.
+ */
+int transport_read(transport* t, void* buf, int size, int timeout_ms)
+{
+  if (t->rxlen == 0)
+  {
+    int n = transport_fill(t, timeout_ms);
+    if (n <= 0)
+      return n;
+  }
+
+  int n = size < t->rxlen ? size : t->rxlen;
+  memcpy(buf, t->rxbuf + t->rxpos, n);
+  transport_consume(t, n);
+  return n;
+}
+
+/**
+ * discards everything buffered, and anything already waiting on the link
+ */
+void transport_flush(transport* t)
+{
+  static uint8_t tmp[16384];
+
+  t->rxpos = 0;
+  t->rxlen = 0;
+
+  int n;
+  while ((n = t->ops->read(t, tmp, sizeof(tmp))) > 0)
+  {
+    if (t->tap != NULL)
+      transport_tap_record(t, 'R', tmp, n);
+  }
+}
+
+bool transport_set_speed(transport* t, int bps)
+{
+  if (t->ops->set_speed == NULL)
+    return true;  // nothing to do for sockets
+
+  return t->ops->set_speed(t, bps);
+}
+
+/**
+ * waits until everything written has actually left the host
+ */
+void transport_drain(transport* t)
+{
+  if (t->ops->drain != NULL)
+    t->ops->drain(t);
+}
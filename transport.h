@@ -0,0 +1,87 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+/**
+ * transport.h - the one connection to the mega65's serial monitor, shared by
+ * the debugger commands, the screenshot code and ftp.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct transport transport;
+
+// each kind of link (tty, tcp#, unix#) is a backend providing these
+typedef struct
+{
+  const char* name;
+  bool (*match)(const char* portname);
+  bool (*open)(transport* t, const char* portname);
+  void (*close)(transport* t);
+  int (*wait)(transport* t, int timeout_ms);     // 1 = readable, 0 = timed out, -1 = error
+  int (*read)(transport* t, uint8_t* buf, int size);
+  int (*write)(transport* t, const uint8_t* buf, int size);
+  bool (*set_speed)(transport* t, int bps);      // NULL for links without a baud rate
+  void (*drain)(transport* t);                   // NULL if writes can't be drained
+} transport_ops;
+
+#define TRANSPORT_RXBUF_SIZE (128*1024)
+
+struct transport
+{
+  const transport_ops* ops;
+  int fd;
+  int speed;              // bps for a tty, 0 for sockets
+  int timeout_ms;         // how long to wait on a response before giving up
+
+  // pacing for commands typed at the monitor (see transport_write_command)
+  int char_us;            // time for one character on the wire
+  int echo_us;            // measured turnaround before the monitor echoes a command
+  int byte_ns;            // measured time per byte of a bulk upload
+
+  // read-ahead buffer, holding rxlen bytes from rxbuf[rxpos]
+  uint8_t rxbuf[TRANSPORT_RXBUF_SIZE];
+  int rxpos;
+  int rxlen;
+
+  unsigned long long tx_bytes;
+  unsigned long long rx_bytes;
+
+  void* priv;             // backend-specific state
+
+  // if recording, the traffic is also written here (see tap.c)
+  FILE* tap;
+  long long tap_start_us;
+};
+
+extern transport* monitor_link;
+extern const char* transport_record_path;
+extern const transport_ops replay_ops;
+
+transport* transport_open(const char* portname);
+void transport_close(transport* t);
+int transport_write(transport* t, const void* buf, int len);
+int transport_write_command(transport* t, const char* cmd, int len);
+int transport_write_payload(transport* t, const void* buf, int len);
+int transport_fill(transport* t, int timeout_ms);
+int transport_peek(transport* t, const uint8_t** data);
+void transport_consume(transport* t, int n);
+int transport_read(transport* t, void* buf, int size, int timeout_ms);
+void transport_flush(transport* t);
+bool transport_set_speed(transport* t, int bps);
+void transport_drain(transport* t);
+long long transport_time_ms(void);
+long long transport_time_us(void);
+
+bool transport_tap_open(transport* t, const char* path);
+void transport_tap_close(transport* t);
+void transport_tap_record(transport* t, char dir, const uint8_t* buf, int len);
+
+int transport_fd_wait(transport* t, int timeout_ms);
+int transport_fd_read(transport* t, uint8_t* buf, int size);
+int transport_fd_write(transport* t, const uint8_t* buf, int size);
+
+#endif // TRANSPORT_H
@@ -0,0 +1,26 @@
+/* vim: set expandtab shiftwidth=2 tabstop=2: */
+
+// unlz.a65, assembled at $C010 (see there for how it's used)
+
+unsigned int unlzroutine_len=164;
+unsigned char unlzroutine[]={
+0x08,0x78,0xd8,0x48,0xda,0x5a,0xdb,0x7b,0x48,0xa9,0xc0,0x5b,0xa3,0x00,0x20,0x80,
+0xc0,0xaa,0x30,0x0c,0xe8,0x20,0x80,0xc0,0x20,0x92,0xc0,0xca,0xd0,0xf7,0x80,0xee,
+0x29,0x7f,0x18,0x69,0x03,0xaa,0x20,0x80,0xc0,0x85,0x08,0x20,0x80,0xc0,0x85,0x09,
+0x05,0x08,0xf0,0x32,0x38,0xa5,0x04,0xe5,0x08,0x85,0x08,0xa5,0x05,0xe5,0x09,0x85,
+0x09,0xa5,0x06,0xe9,0x00,0x85,0x0a,0xa5,0x07,0xe9,0x00,0x85,0x0b,0xea,0xb2,0x08,
+0x20,0x92,0xc0,0xe6,0x08,0xd0,0x0a,0xe6,0x09,0xd0,0x06,0xe6,0x0a,0xd0,0x02,0xe6,
+0x0b,0xca,0xd0,0xe9,0x80,0xa8,0x68,0x5b,0xfb,0x7a,0xfa,0x68,0x4c,0x7c,0xc0,0x28,
+0xea,0xb2,0x00,0xe6,0x00,0xd0,0x0a,0xe6,0x01,0xd0,0x06,0xe6,0x02,0xd0,0x02,0xe6,
+0x03,0x60,0xea,0x92,0x04,0x48,0x18,0x65,0x0c,0x69,0x00,0x85,0x0c,0x18,0x65,0x0d,
+0x69,0x00,0x85,0x0d,0x68,0xe6,0x04,0xd0,0x0a,0xe6,0x05,0xd0,0x06,0xe6,0x06,0xd0,
+0x02,0xe6,0x07,0x60
+};
+
+// offsets of the bytes holding the routine's page (ie, $C0), to move it elsewhere
+int unlzroutine_relocs[]={ 10, 16, 23, 26, 40, 45, 82, 110, -1 };
+
+// offsets from the start of the page of its entry point, and of its idle loop
+// (the PLP that puts P back follows it)
+int unlzroutine_entry=0x10;
+int unlzroutine_idle=0x7c;